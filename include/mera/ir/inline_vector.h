@@ -0,0 +1,210 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_IR_INLINE_VECTOR_H
+#define MDNA_IR_INLINE_VECTOR_H
+
+#include <algorithm>
+#include <array>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <nop/serializer.h>
+
+namespace mera {
+namespace ir {
+
+/**
+ * @brief Maximum rank supported by Shape and Layout.
+ */
+constexpr size_t kMaxRank = 6;
+
+/**
+ * @brief Vector-like container with a fixed capacity of N elements stored inline, so it never allocates.
+ * Serializes exactly like std::vector<T>.
+ */
+template <class T, size_t N>
+class InlineVector {
+ public:
+  using value_type = T;
+  using size_type = size_t;
+  using reference = T&;
+  using const_reference = const T&;
+  using iterator = T*;
+  using const_iterator = const T*;
+
+  InlineVector() = default;
+
+  InlineVector(std::initializer_list<T> init) : InlineVector(init.begin(), init.end()) {}
+
+  template <class It, class = std::enable_if_t<!std::is_integral<It>::value>>
+  InlineVector(It first, It last) {
+    for (; first != last; ++first) {
+      push_back(*first);
+    }
+  }
+
+  InlineVector(const std::vector<T> &v) : InlineVector(v.begin(), v.end()) {}
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  static constexpr size_t capacity() { return N; }
+
+  T *data() { return data_.data(); }
+  const T *data() const { return data_.data(); }
+
+  iterator begin() { return data_.data(); }
+  iterator end() { return data_.data() + size_; }
+  const_iterator begin() const { return data_.data(); }
+  const_iterator end() const { return data_.data() + size_; }
+
+  T &operator[](size_t pos) { return data_[pos]; }
+  const T &operator[](size_t pos) const { return data_[pos]; }
+
+  T &at(size_t pos) {
+    CheckRange(pos);
+    return data_[pos];
+  }
+
+  const T &at(size_t pos) const {
+    CheckRange(pos);
+    return data_[pos];
+  }
+
+  T &back() { return data_[size_ - 1]; }
+  const T &back() const { return data_[size_ - 1]; }
+
+  void push_back(const T &v) {
+    if (size_ == N) {
+      throw std::length_error("InlineVector capacity of " + std::to_string(N) + " exceeded");
+    }
+    data_[size_++] = v;
+  }
+
+  void clear() { size_ = 0; }
+
+  void resize(size_t n) {
+    if (n > N) {
+      throw std::length_error("InlineVector capacity of " + std::to_string(N) + " exceeded");
+    }
+    std::fill(data_.begin() + std::min(n, size_), data_.begin() + n, T());
+    size_ = n;
+  }
+
+  std::vector<T> ToVector() const { return std::vector<T>(begin(), end()); }
+
+  operator std::vector<T>() const { return ToVector(); }
+
+ private:
+  void CheckRange(size_t pos) const {
+    if (pos >= size_) {
+      throw std::out_of_range("InlineVector index " + std::to_string(pos) + " out of range " + std::to_string(size_));
+    }
+  }
+
+  std::array<T, N> data_{};
+  size_t size_{0};
+};
+
+template <class T, size_t N>
+inline bool operator==(const InlineVector<T, N> &lhs, const InlineVector<T, N> &rhs) {
+  return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+template <class T, size_t N>
+inline bool operator!=(const InlineVector<T, N> &lhs, const InlineVector<T, N> &rhs) { return !(lhs == rhs); }
+
+} // namespace ir
+} // namespace mera
+
+namespace nop {
+
+// Wire format is the one of std::vector<T>, so modules serialized before the inline storage remain readable: a
+// binary blob of size() * sizeof(T) bytes for integral elements, an array of encoded elements otherwise. Elements
+// are written from and read into the inline storage directly.
+template <class T, size_t N>
+struct Encoding<mera::ir::InlineVector<T, N>> : EncodingIO<mera::ir::InlineVector<T, N>> {
+  using Type = mera::ir::InlineVector<T, N>;
+  static constexpr bool kBinary = std::is_integral<T>::value;
+
+  static constexpr EncodingByte Prefix(const Type & /*value*/) {
+    return kBinary ? EncodingByte::Binary : EncodingByte::Array;
+  }
+
+  static std::size_t Size(const Type &value) {
+    if constexpr (kBinary) {
+      const std::size_t bytes = value.size() * sizeof(T);
+      return BaseEncodingSize(Prefix(value)) + Encoding<SizeType>::Size(bytes) + bytes;
+    } else {
+      std::size_t size = BaseEncodingSize(Prefix(value)) + Encoding<SizeType>::Size(value.size());
+      for (const T &v : value) {
+        size += Encoding<T>::Size(v);
+      }
+      return size;
+    }
+  }
+
+  static constexpr bool Match(EncodingByte prefix) {
+    return prefix == (kBinary ? EncodingByte::Binary : EncodingByte::Array);
+  }
+
+  template <typename Writer>
+  static Status<void> WritePayload(EncodingByte /*prefix*/, const Type &value, Writer *writer) {
+    if constexpr (kBinary) {
+      auto status = Encoding<SizeType>::Write(SizeType(value.size() * sizeof(T)), writer);
+      if (!status) {
+        return status;
+      }
+      return writer->Write(value.begin(), value.end());
+    } else {
+      auto status = Encoding<SizeType>::Write(SizeType(value.size()), writer);
+      for (auto it = value.begin(); status && it != value.end(); ++it) {
+        status = Encoding<T>::Write(*it, writer);
+      }
+      return status;
+    }
+  }
+
+  template <typename Reader>
+  static Status<void> ReadPayload(EncodingByte /*prefix*/, Type *value, Reader *reader) {
+    SizeType size = 0;
+    auto status = Encoding<SizeType>::Read(&size, reader);
+    if (!status) {
+      return status;
+    }
+    if constexpr (kBinary) {
+      if (size % sizeof(T) != 0 || size / sizeof(T) > N) {
+        return ErrorStatus::InvalidContainerLength;
+      }
+      value->resize(size / sizeof(T));
+      return reader->Read(value->begin(), value->end());
+    } else {
+      if (size > N) {
+        return ErrorStatus::InvalidContainerLength;
+      }
+      value->resize(size);
+      for (auto it = value->begin(); status && it != value->end(); ++it) {
+        status = Encoding<T>::Read(&*it, reader);
+      }
+      return status;
+    }
+  }
+};
+
+} // namespace nop
+
+#endif // MDNA_IR_INLINE_VECTOR_H
@@ -16,9 +16,13 @@
 #ifndef MDNA_IR_SHAPE_H
 #define MDNA_IR_SHAPE_H
 
+#include <algorithm>
 #include <array>
+#include <cstdint>
+#include <iterator>
 #include <vector>
 #include <nop/serializer.h>
+#include "inline_vector.h"
 
 namespace mera {
 namespace ir {
@@ -27,7 +31,7 @@ namespace ir {
  * @brief Class container describing the layout of a particular shape
  */
 struct Layout {
-  std::vector<char> layout_values;
+  InlineVector<char, kMaxRank> layout_values;
 
   NOP_STRUCTURE(Layout, layout_values);
 
@@ -81,27 +85,40 @@ namespace layout {
  * @brief Class describing the shape and dimensions of a Tensor.
  */
 struct Shape {
-  std::vector<int> shape;
+  using Dims = InlineVector<int, kMaxRank>;
+
+  Dims shape;
   int rank;
-  int size;
+  int64_t size;
   Layout layout;
   NOP_STRUCTURE(Shape, shape, rank, size, layout);
 
-  Shape(const std::vector<int> &shape, const Layout &layout):
+  Shape(const Dims &shape, const Layout &layout):
     shape(shape),
     rank(shape.size()),
-    size([](const std::vector<int> &s) -> int { int r = 1; for (const auto & s_val : s) { r *= s_val; } return r; }(shape)),
+    size(NumElements(shape)),
     layout(layout) {
     if ((size_t)rank != layout.layout_values.size()) {
       throw std::runtime_error("Incorrect rank (" + std::to_string(rank) + ") for layout " + layout.AsStr());
     }
   }
 
-  Shape(std::initializer_list<int> shape, const Layout &layout): Shape(std::vector<int>(shape), layout) {}
+  Shape(const std::vector<int> &shape, const Layout &layout): Shape(CheckedDims(shape.begin(), shape.end()), layout) {}
+  Shape(std::initializer_list<int> shape, const Layout &layout):
+    Shape(CheckedDims(shape.begin(), shape.end()), layout) {}
   Shape() : Shape({1}, layout::x) {} // Default is single value
 
-  int& at(std::vector<int>::size_type pos)  { return shape.at(pos); }
-  const int& at(std::vector<int>::size_type pos) const { return shape.at(pos); }
+  int& at(Dims::size_type pos)  { return shape.at(pos); }
+  const int& at(Dims::size_type pos) const { return shape.at(pos); }
+
+  /**
+   * @brief Returns the number of elements of a tensor with dimensions 's'.
+   */
+  static int64_t NumElements(const Dims &s) {
+    int64_t r = 1;
+    for (const auto &s_val : s) { r *= s_val; }
+    return r;
+  }
 
   /**
    * @brief Returns the current dimension of the layout parameter 'lay_val'. Error if layout does not exist
@@ -144,9 +161,7 @@ struct Shape {
   void PadDimTo(char lay_val, size_t value) {
     const int axis = AxisOf(lay_val);
     shape.at(axis) = ((shape.at(axis) + value - 1) / value) * value;
-    int r = 1.0;
-    for (const auto &s : shape) { r *= s; }
-    size = r;
+    size = NumElements(shape);
   }
 
   /**
@@ -197,7 +212,18 @@ struct Shape {
   template<size_t N>
   Shape ReshapeAs(const Layout &lay_ext) const {
     auto d = UnpackAs<N>(lay_ext);
-    return Shape{std::vector<int>(d.begin(), d.end()), lay_ext};
+    return Shape{CheckedDims(d.begin(), d.end()), lay_ext};
+  }
+
+ private:
+  template <class It>
+  static Dims CheckedDims(It first, It last) {
+    const size_t rank = std::distance(first, last);
+    if (rank > kMaxRank) {
+      throw std::runtime_error("Rank " + std::to_string(rank) + " exceeds the maximum supported rank of "
+        + std::to_string(kMaxRank));
+    }
+    return Dims(first, last);
   }
 };
 
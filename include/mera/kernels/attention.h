@@ -0,0 +1,310 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_KERNELS_ATTENTION_H
+#define MDNA_KERNELS_ATTENTION_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../mdna_ir.h"
+
+/**
+ * @file attention.h
+ * @brief Fused multi head attention for the host, tiled over keys with an online softmax, and a key/value cache
+ * for incremental decoding.
+ *
+ * Rows of Q, K and V hold all heads back to back ([num_heads][head_dim]) and may be strided, so slices of a fused
+ * QKV buffer can be passed directly. The output has rows of num_heads * head_dim. Executors keep one KvCache per
+ * Attention in every session, see Executor::CreateSession().
+ */
+namespace mera {
+namespace kernels {
+
+struct AttentionParams {
+  int num_heads;
+  int head_dim;
+  // Query i only sees keys up to its own position, the queries being the last rows of the sequence
+  bool causal{false};
+  // Score scale, 0 for 1 / sqrt(head_dim)
+  float scale{0};
+
+  // Where an ir::Attention finds its operands, filled by Of(): 'query_length' query rows and 'seq_length' key and
+  // value rows, each operand starting at column 'slice_*' of rows 'stride_*' floats wide. Lengths of 0 mean the
+  // caller passes the operands explicitly.
+  int query_length{0};
+  int seq_length{0};
+  size_t slice_query{0}, slice_key{0}, slice_value{0};
+  size_t stride_query{0}, stride_key{0}, stride_value{0};
+
+  /**
+   * @brief Parameters of 'op'. 'has_mask' is taken as a causal mask, the only mask the operator can express. The
+   * innermost dimension of each input is its row, and 'slice_*' the column of that row where the operand starts.
+   */
+  static AttentionParams Of(const ir::Attention &op) {
+    if (op.num_heads <= 0 || op.dim % op.num_heads != 0) {
+      throw std::runtime_error("Attention dim " + std::to_string(op.dim) + " not divisible by " +
+                               std::to_string(op.num_heads) + " heads");
+    }
+    if (op.query_length <= 0 || op.seq_length <= 0) {
+      throw std::runtime_error("Attention query_length and seq_length must be positive");
+    }
+    if (op.has_mask && op.query_length > op.seq_length) {
+      throw std::runtime_error("Causal attention needs at least as many keys as queries");
+    }
+    AttentionParams p{op.num_heads, op.dim / op.num_heads, op.has_mask, 0};
+    p.query_length = op.query_length;
+    p.seq_length = op.seq_length;
+    p.slice_query = Slice("query", op.input_query, op.slice_query, op.dim, op.query_length, p.stride_query);
+    p.slice_key = Slice("key", op.input_key, op.slice_key, op.dim, op.seq_length, p.stride_key);
+    p.slice_value = Slice("value", op.input_value, op.slice_value, op.dim, op.seq_length, p.stride_value);
+    return p;
+  }
+
+  int Dim() const { return num_heads * head_dim; }
+
+ private:
+  // Checks that 'dim' columns from 'slice' fit in the rows of 'input' and that it holds 'rows' of them
+  static size_t Slice(const char *name, const ir::Tensor &input, int slice, int dim, int rows, size_t &stride) {
+    const ir::Shape &s = input.shape;
+    const int width = s.rank > 0 ? s.shape[s.rank - 1] : 0;
+    if (slice < 0 || slice + dim > width) {
+      throw std::runtime_error(std::string("Attention ") + name + " slice [" + std::to_string(slice) + ", " +
+                               std::to_string(slice + dim) + ") exceeds rows of " + std::to_string(width));
+    }
+    if (s.size / width < rows) {
+      throw std::runtime_error(std::string("Attention ") + name + " holds " + std::to_string(s.size / width) +
+                               " rows, " + std::to_string(rows) + " needed");
+    }
+    stride = size_t(width);
+    return size_t(slice);
+  }
+};
+
+/**
+ * @brief Keys and values of all tokens decoded so far, stored per head ([head][position][head_dim]) so each head
+ * scans contiguous memory. It lives across Run calls, one per sequence being decoded, and only serves kernels
+ * with the heads and head_dim it was created for.
+ */
+class KvCache {
+ public:
+  KvCache(const AttentionParams &p, size_t max_length):
+    p_(p), heads_(p.num_heads), head_dim_(p.head_dim), capacity_(max_length),
+    k_(size_t(heads_) * capacity_ * head_dim_), v_(k_.size()) {}
+
+  const AttentionParams &Params() const { return p_; }
+  size_t Length() const { return length_; }
+  size_t Capacity() const { return capacity_; }
+
+  void Reset() { length_ = 0; }
+
+  /**
+   * @brief Appends 'n' tokens. Row t of 'k' and 'v' starts at t * stride.
+   */
+  void Append(const float *k, const float *v, size_t n, size_t stride) {
+    if (length_ + n > capacity_) {
+      throw std::runtime_error("KV cache overflow: " + std::to_string(length_ + n) + " tokens, capacity " +
+                               std::to_string(capacity_));
+    }
+    for (size_t t = 0; t < n; ++t) {
+      for (int h = 0; h < heads_; ++h) {
+        const size_t dst = (size_t(h) * capacity_ + length_ + t) * head_dim_;
+        std::copy_n(k + t * stride + size_t(h) * head_dim_, head_dim_, k_.data() + dst);
+        std::copy_n(v + t * stride + size_t(h) * head_dim_, head_dim_, v_.data() + dst);
+      }
+    }
+    length_ += n;
+  }
+
+  const float *Keys(int head) const { return k_.data() + size_t(head) * capacity_ * head_dim_; }
+  const float *Values(int head) const { return v_.data() + size_t(head) * capacity_ * head_dim_; }
+
+ private:
+  AttentionParams p_;
+  int heads_;
+  size_t head_dim_;
+  size_t capacity_;
+  size_t length_{0};
+  std::vector<float> k_;
+  std::vector<float> v_;
+};
+
+/**
+ * @brief Attention computed one tile of kKeyTile keys at a time for blocks of kQueryTile queries. Each query
+ * keeps a running maximum, softmax denominator and weighted sum of values, rescaled whenever the maximum grows,
+ * so memory is O(kQueryTile * (head_dim + kKeyTile)) whatever the sequence length and the score matrix is never
+ * materialized. Run() and RunIncremental() are thread safe for distinct caches.
+ */
+class AttentionKernel {
+ public:
+  static constexpr size_t kKeyTile = 64;
+  static constexpr size_t kQueryTile = 16;
+
+  explicit AttentionKernel(const AttentionParams &p): p_(p) {
+    if (p_.num_heads <= 0 || p_.head_dim <= 0) {
+      throw std::runtime_error("Attention needs positive heads and head_dim");
+    }
+    if (p_.scale == 0) {
+      p_.scale = 1.0f / std::sqrt(float(p_.head_dim));
+    }
+  }
+
+  /**
+   * @brief Full attention of 'q_len' queries over 'kv_len' keys and values. Rows of q start every 'q_stride'
+   * floats, rows of k and v every 'kv_stride' floats.
+   */
+  void Run(const float *q, size_t q_len, size_t q_stride, const float *k, const float *v, size_t kv_len,
+           size_t kv_stride, float *out) const {
+    RunHeads(q, q_len, q_stride, k, kv_stride, v, kv_stride, kv_len, out);
+  }
+
+  /**
+   * @brief Attention of an ir::Attention over its input buffers, laid out as described by the params built with
+   * AttentionParams::Of(). The same buffer may be passed for several operands, as for a fused QKV tensor.
+   */
+  void Run(const float *query, const float *key, const float *value, float *out) const {
+    if (p_.query_length <= 0 || p_.seq_length <= 0) {
+      throw std::logic_error("Attention operand layout unknown, build the params with AttentionParams::Of()");
+    }
+    RunHeads(query + p_.slice_query, p_.query_length, p_.stride_query, key + p_.slice_key, p_.stride_key,
+             value + p_.slice_value, p_.stride_value, p_.seq_length, out);
+  }
+
+  /**
+   * @brief One decoding step: appends the keys and values of the 'n_new' new tokens to 'cache' and attends their
+   * queries over the whole cache. Only the new query rows are computed, so a step costs O(cache length) instead
+   * of recomputing the full sequence. The kernel must be causal: the new tokens are the last of the sequence, and
+   * earlier tokens never see them, which is what causal attention over the whole sequence computes. Non causal
+   * attention would update the outputs of earlier tokens as well, so it has no incremental form.
+   */
+  void RunIncremental(KvCache &cache, const float *q, const float *k_new, const float *v_new, size_t n_new,
+                      size_t stride, float *out) const {
+    if (!p_.causal) {
+      throw std::logic_error("Incremental attention needs a causal kernel");
+    }
+    if (cache.Params().num_heads != p_.num_heads || cache.Params().head_dim != p_.head_dim) {
+      throw std::invalid_argument("KV cache of " + std::to_string(cache.Params().num_heads) + " heads of " +
+                                  std::to_string(cache.Params().head_dim) + " used with a kernel of " +
+                                  std::to_string(p_.num_heads) + " heads of " + std::to_string(p_.head_dim));
+    }
+    cache.Append(k_new, v_new, n_new, stride);
+    for (int h = 0; h < p_.num_heads; ++h) {
+      const size_t off = size_t(h) * p_.head_dim;
+      Head(q + off, n_new, stride, cache.Keys(h), p_.head_dim, cache.Values(h), p_.head_dim, cache.Length(),
+           out + off);
+    }
+  }
+
+ private:
+  void RunHeads(const float *q, size_t q_len, size_t q_stride, const float *k, size_t k_stride, const float *v,
+                size_t v_stride, size_t kv_len, float *out) const {
+    if (p_.causal && q_len > kv_len) {
+      throw std::runtime_error("Causal attention needs at least as many keys as queries");
+    }
+    for (int h = 0; h < p_.num_heads; ++h) {
+      const size_t off = size_t(h) * p_.head_dim;
+      Head(q + off, q_len, q_stride, k + off, k_stride, v + off, v_stride, kv_len, out + off);
+    }
+  }
+
+  void Head(const float *q, size_t q_len, size_t q_stride, const float *k, size_t k_stride, const float *v,
+            size_t v_stride, size_t kv_len, float *out) const {
+    const size_t hd = p_.head_dim;
+    const size_t out_stride = size_t(p_.Dim());
+    const size_t first_pos = kv_len - std::min(kv_len, q_len);
+    std::vector<float> acc(kQueryTile * hd), max(kQueryTile), sum(kQueryTile), scores(kKeyTile);
+
+    for (size_t q0 = 0; q0 < q_len; q0 += kQueryTile) {
+      const size_t qn = std::min(kQueryTile, q_len - q0);
+      std::fill(acc.begin(), acc.end(), 0.0f);
+      std::fill(max.begin(), max.end(), -std::numeric_limits<float>::infinity());
+      std::fill(sum.begin(), sum.end(), 0.0f);
+      // Keys past the last visible position of the block's last query are skipped entirely
+      const size_t k_end = p_.causal ? std::min(kv_len, first_pos + q0 + qn) : kv_len;
+
+      for (size_t k0 = 0; k0 < k_end; k0 += kKeyTile) {
+        const size_t kn = std::min(kKeyTile, k_end - k0);
+        for (size_t i = 0; i < qn; ++i) {
+          const float *qi = q + (q0 + i) * q_stride;
+          // Keys [k0, k0 + visible) are at or before the query's position
+          const size_t end = first_pos + q0 + i + 1;
+          const size_t visible = p_.causal ? (end > k0 ? std::min(kn, end - k0) : 0) : kn;
+          if (visible == 0) {
+            continue;
+          }
+          float tile_max = -std::numeric_limits<float>::infinity();
+          for (size_t j = 0; j < visible; ++j) {
+            scores[j] = Dot(qi, k + (k0 + j) * k_stride, hd) * p_.scale;
+            tile_max = std::max(tile_max, scores[j]);
+          }
+          const float new_max = std::max(max[i], tile_max);
+          const float rescale = std::exp(max[i] - new_max);
+          float *acc_i = acc.data() + i * hd;
+          for (size_t d = 0; d < hd; ++d) {
+            acc_i[d] *= rescale;
+          }
+          float tile_sum = 0;
+          for (size_t j = 0; j < visible; ++j) {
+            const float pj = std::exp(scores[j] - new_max);
+            tile_sum += pj;
+            const float *vj = v + (k0 + j) * v_stride;
+            for (size_t d = 0; d < hd; ++d) {
+              acc_i[d] += pj * vj[d];
+            }
+          }
+          sum[i] = sum[i] * rescale + tile_sum;
+          max[i] = new_max;
+        }
+      }
+      for (size_t i = 0; i < qn; ++i) {
+        float *o = out + (q0 + i) * out_stride;
+        const float inv = sum[i] > 0 ? 1.0f / sum[i] : 0.0f;
+        for (size_t d = 0; d < hd; ++d) {
+          o[d] = acc[i * hd + d] * inv;
+        }
+      }
+    }
+  }
+
+  // Eight independent partial sums, so the reduction vectorizes without reassociation flags
+  static float Dot(const float *a, const float *b, size_t n) {
+    float part[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      for (size_t l = 0; l < 8; ++l) {
+        part[l] += a[i + l] * b[i + l];
+      }
+    }
+    float r = 0;
+    for (; i < n; ++i) {
+      r += a[i] * b[i];
+    }
+    for (const float p : part) {
+      r += p;
+    }
+    return r;
+  }
+
+  AttentionParams p_;
+};
+
+}  // namespace kernels
+}  // namespace mera
+
+#endif  // MDNA_KERNELS_ATTENTION_H
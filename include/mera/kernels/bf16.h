@@ -0,0 +1,65 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_KERNELS_BF16_H
+#define MDNA_KERNELS_BF16_H
+
+#include <cstdint>
+#include <cstring>
+
+namespace mera {
+namespace kernels {
+
+/**
+ * @brief Raw storage of a DataType::BrainFloat16 value: the upper half of an IEEE float.
+ */
+using bf16_t = uint16_t;
+
+inline float BF16ToFloat(bf16_t v) {
+  const uint32_t bits = uint32_t(v) << 16;
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+/**
+ * @brief Rounds to nearest even. NaNs stay NaNs.
+ */
+inline bf16_t FloatToBF16(float f) {
+  uint32_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  if ((bits & 0x7fffffffu) > 0x7f800000u) {
+    return bf16_t((bits >> 16) | 0x40);
+  }
+  bits += 0x7fffu + ((bits >> 16) & 1);
+  return bf16_t(bits >> 16);
+}
+
+inline void BF16ToFloat(const bf16_t *src, float *dst, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = BF16ToFloat(src[i]);
+  }
+}
+
+inline void FloatToBF16(const float *src, bf16_t *dst, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = FloatToBF16(src[i]);
+  }
+}
+
+}  // namespace kernels
+}  // namespace mera
+
+#endif  // MDNA_KERNELS_BF16_H
@@ -0,0 +1,338 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_KERNELS_CONV2D_H
+#define MDNA_KERNELS_CONV2D_H
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "bf16.h"
+#include "conv_geometry.h"
+
+/**
+ * @file conv2d.h
+ * @brief Host kernels of Conv2d and TransConv2d in float and bf16, with a Winograd path for 3x3 stride 1 layers.
+ *
+ * Activations are NHWC and weights OIHW. bf16 tensors are computed in float and rounded once on output.
+ */
+namespace mera {
+namespace kernels {
+
+/**
+ * @brief Winograd selection of one layer. AUTO uses F(4x4, 3x3) when the output is at least 8x8 and F(2x2, 3x3)
+ * otherwise. OFF keeps the direct convolution, for layers where the extra rounding of the transforms matters: it
+ * is the per layer switch, set by whoever builds the Conv2dKernel of that layer. The compiler never sees these
+ * host kernels, so there is no ccfg key for it.
+ */
+enum class WinogradMode { AUTO, OFF, F2X2, F4X4 };
+
+struct Conv2dKernelOptions {
+  WinogradMode winograd{WinogradMode::AUTO};
+};
+
+/**
+ * @brief Whether the Winograd path applies: 3x3 kernel, stride 1, dilation 1, no groups, not transposed.
+ */
+inline bool IsWinogradEligible(const Conv2dGeometry &g) {
+  return !g.transposed && g.groups == 1 && g.k_h == 3 && g.k_w == 3 && g.strides.h == 1 && g.strides.w == 1 &&
+         g.dilations.h == 1 && g.dilations.w == 1;
+}
+
+namespace detail {
+
+/**
+ * @brief Transform matrices of Winograd F(m x m, 3 x 3), with tile size t = m + 2.
+ */
+template <int M>
+struct Winograd;
+
+template <>
+struct Winograd<2> {
+  static constexpr int kTile = 4;
+  static constexpr float BT[4][4] = {{1, 0, -1, 0}, {0, 1, 1, 0}, {0, -1, 1, 0}, {0, 1, 0, -1}};
+  static constexpr float G[4][3] = {{1, 0, 0}, {0.5f, 0.5f, 0.5f}, {0.5f, -0.5f, 0.5f}, {0, 0, 1}};
+  static constexpr float AT[2][4] = {{1, 1, 1, 0}, {0, 1, -1, -1}};
+};
+
+template <>
+struct Winograd<4> {
+  static constexpr int kTile = 6;
+  static constexpr float BT[6][6] = {{4, 0, -5, 0, 1, 0}, {0, -4, -4, 1, 1, 0}, {0, 4, -4, -1, 1, 0},
+                                     {0, -2, -1, 2, 1, 0}, {0, 2, -1, -2, 1, 0}, {0, 4, 0, -5, 0, 1}};
+  static constexpr float G[6][3] = {{1.0f / 4, 0, 0},
+                                    {-1.0f / 6, -1.0f / 6, -1.0f / 6},
+                                    {-1.0f / 6, 1.0f / 6, -1.0f / 6},
+                                    {1.0f / 24, 1.0f / 12, 1.0f / 6},
+                                    {1.0f / 24, -1.0f / 12, 1.0f / 6},
+                                    {0, 0, 1}};
+  static constexpr float AT[4][6] = {{1, 1, 1, 1, 1, 0}, {0, 1, -1, 2, -2, 0}, {0, 1, 1, 4, 4, 0},
+                                     {0, 1, -1, 8, -8, 1}};
+};
+
+/**
+ * @brief dst[i][j][:] = sum_k sum_l L[i][k] * src[k][l][:] * R[j][l], on planes of 'n' contiguous values. Zero
+ * coefficients, which are most of them, are skipped.
+ */
+template <int I, int K, int J, int L>
+inline void Sandwich(const float (&lhs)[I][K], const float *src, const float (&rhs)[J][L], size_t n, float *tmp,
+                     float *dst) {
+  // tmp[i][l] = sum_k lhs[i][k] * src[k][l]
+  std::fill(tmp, tmp + size_t(I) * L * n, 0.0f);
+  for (int i = 0; i < I; ++i) {
+    for (int k = 0; k < K; ++k) {
+      const float c = lhs[i][k];
+      if (c == 0) {
+        continue;
+      }
+      for (int l = 0; l < L; ++l) {
+        float *t = tmp + (size_t(i) * L + l) * n;
+        const float *s = src + (size_t(k) * L + l) * n;
+        for (size_t v = 0; v < n; ++v) {
+          t[v] += c * s[v];
+        }
+      }
+    }
+  }
+  std::fill(dst, dst + size_t(I) * J * n, 0.0f);
+  for (int i = 0; i < I; ++i) {
+    for (int j = 0; j < J; ++j) {
+      float *d = dst + (size_t(i) * J + j) * n;
+      for (int l = 0; l < L; ++l) {
+        const float c = rhs[j][l];
+        if (c == 0) {
+          continue;
+        }
+        const float *t = tmp + (size_t(i) * L + l) * n;
+        for (size_t v = 0; v < n; ++v) {
+          d[v] += c * t[v];
+        }
+      }
+    }
+  }
+}
+
+}  // namespace detail
+
+/**
+ * @brief Float convolution with weights packed, or Winograd transformed, once at construction. Meant to be built
+ * when the executor loads and run for every inference. Run() is thread safe.
+ */
+class Conv2dKernel {
+ public:
+  /**
+   * @param weight OIHW weights.
+   */
+  Conv2dKernel(const Conv2dGeometry &geom, const float *weight, Conv2dKernelOptions opts = {}): g_(geom) {
+    g_.Validate();
+    mode_ = ResolveMode(opts.winograd);
+    if (mode_ == WinogradMode::F2X2) {
+      TransformWeights<2>(weight);
+    } else if (mode_ == WinogradMode::F4X4) {
+      TransformWeights<4>(weight);
+    } else {
+      PackDirect(weight);
+    }
+  }
+
+  Conv2dKernel(const Conv2dGeometry &geom, const bf16_t *weight, Conv2dKernelOptions opts = {}):
+    Conv2dKernel(geom, Widen(weight, size_t(geom.out_c) * geom.InChannelsPerGroup() * geom.k_h * geom.k_w).data(),
+                 opts) {}
+
+  /**
+   * @brief Algorithm in use: OFF for the direct convolution, otherwise the Winograd variant.
+   */
+  WinogradMode winograd() const { return mode_; }
+
+  void Run(const float *input, float *output) const {
+    if (mode_ == WinogradMode::F2X2) {
+      RunWinograd<2>(input, output);
+    } else if (mode_ == WinogradMode::F4X4) {
+      RunWinograd<4>(input, output);
+    } else {
+      RunDirect(input, output);
+    }
+  }
+
+  void Run(const bf16_t *input, bf16_t *output) const {
+    const auto in = Widen(input, size_t(g_.batch) * g_.in_h * g_.in_w * g_.in_c);
+    std::vector<float> out(size_t(g_.batch) * g_.out_h * g_.out_w * g_.out_c);
+    Run(in.data(), out.data());
+    FloatToBF16(out.data(), output, out.size());
+  }
+
+ private:
+  static std::vector<float> Widen(const bf16_t *src, size_t n) {
+    std::vector<float> r(n);
+    BF16ToFloat(src, r.data(), n);
+    return r;
+  }
+
+  WinogradMode ResolveMode(WinogradMode requested) const {
+    if (requested == WinogradMode::OFF || !IsWinogradEligible(g_)) {
+      if (requested == WinogradMode::F2X2 || requested == WinogradMode::F4X4) {
+        throw std::runtime_error("Winograd requested for a convolution that is not 3x3, stride 1, dilation 1");
+      }
+      return WinogradMode::OFF;
+    }
+    if (requested == WinogradMode::AUTO) {
+      return g_.out_h >= 8 && g_.out_w >= 8 ? WinogradMode::F4X4 : WinogradMode::F2X2;
+    }
+    return requested;
+  }
+
+  // Direct path: weights as [group][ky][kx][c][o], so every patch value scales one contiguous row of outputs
+  void PackDirect(const float *weight) {
+    const int icg = g_.InChannelsPerGroup();
+    const int ocg = g_.OutChannelsPerGroup();
+    k_ = size_t(g_.k_h) * g_.k_w * icg;
+    packed_.assign(size_t(g_.groups) * k_ * ocg, 0.0f);
+    for (int o = 0; o < g_.out_c; ++o) {
+      const int grp = o / ocg;
+      for (int c = 0; c < icg; ++c) {
+        for (int ky = 0; ky < g_.k_h; ++ky) {
+          for (int kx = 0; kx < g_.k_w; ++kx) {
+            const size_t k = (size_t(ky) * g_.k_w + kx) * icg + c;
+            packed_[(grp * k_ + k) * ocg + o % ocg] = weight[((size_t(o) * icg + c) * g_.k_h + ky) * g_.k_w + kx];
+          }
+        }
+      }
+    }
+  }
+
+  void RunDirect(const float *input, float *output) const {
+    const int icg = g_.InChannelsPerGroup();
+    const int ocg = g_.OutChannelsPerGroup();
+    std::vector<float> patch(k_);
+    for (int n = 0; n < g_.batch; ++n) {
+      const float *in_n = input + size_t(n) * g_.in_h * g_.in_w * g_.in_c;
+      for (int oy = 0; oy < g_.out_h; ++oy) {
+        for (int ox = 0; ox < g_.out_w; ++ox) {
+          float *out = output + ((size_t(n) * g_.out_h + oy) * g_.out_w + ox) * g_.out_c;
+          std::fill(out, out + g_.out_c, 0.0f);
+          for (int grp = 0; grp < g_.groups; ++grp) {
+            for (int ky = 0; ky < g_.k_h; ++ky) {
+              const int iy = g_.SourceY(oy, ky);
+              for (int kx = 0; kx < g_.k_w; ++kx) {
+                const int ix = iy < 0 ? -1 : g_.SourceX(ox, kx);
+                float *dst = patch.data() + (size_t(ky) * g_.k_w + kx) * icg;
+                if (ix < 0) {
+                  std::fill(dst, dst + icg, 0.0f);
+                } else {
+                  std::copy_n(in_n + (size_t(iy) * g_.in_w + ix) * g_.in_c + grp * icg, icg, dst);
+                }
+              }
+            }
+            float *out_g = out + grp * ocg;
+            const float *w = packed_.data() + grp * k_ * ocg;
+            for (size_t k = 0; k < k_; ++k) {
+              const float x = patch[k];
+              if (x == 0) {
+                continue;
+              }
+              const float *wk = w + k * ocg;
+              for (int o = 0; o < ocg; ++o) {
+                out_g[o] += x * wk[o];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Winograd path: U = G g G^T of every (o, c) pair, stored as [t * t][c][o]
+  template <int M>
+  void TransformWeights(const float *weight) {
+    using W = detail::Winograd<M>;
+    constexpr int T = W::kTile;
+    const size_t ic = g_.in_c, oc = g_.out_c;
+    packed_.assign(size_t(T) * T * ic * oc, 0.0f);
+    float tmp[T * 3], u[T * T];
+    for (size_t o = 0; o < oc; ++o) {
+      for (size_t c = 0; c < ic; ++c) {
+        detail::Sandwich(W::G, weight + (o * ic + c) * 9, W::G, 1, tmp, u);
+        for (int e = 0; e < T * T; ++e) {
+          packed_[(e * ic + c) * oc + o] = u[e];
+        }
+      }
+    }
+  }
+
+  template <int M>
+  void RunWinograd(const float *input, float *output) const {
+    using W = detail::Winograd<M>;
+    constexpr int T = W::kTile;
+    const size_t ic = g_.in_c, oc = g_.out_c;
+    const int tiles_y = (g_.out_h + M - 1) / M;
+    const int tiles_x = (g_.out_w + M - 1) / M;
+    std::vector<float> d(T * T * ic), tmp(T * T * std::max(ic, oc)), v(T * T * ic), m(T * T * oc), y(M * M * oc);
+    for (int n = 0; n < g_.batch; ++n) {
+      const float *in_n = input + size_t(n) * g_.in_h * g_.in_w * ic;
+      float *out_n = output + size_t(n) * g_.out_h * g_.out_w * oc;
+      for (int ty = 0; ty < tiles_y; ++ty) {
+        for (int tx = 0; tx < tiles_x; ++tx) {
+          // Input tile, zero outside of the image
+          for (int i = 0; i < T; ++i) {
+            const int iy = ty * M - g_.padding.top + i;
+            for (int j = 0; j < T; ++j) {
+              const int ix = tx * M - g_.padding.left + j;
+              float *dst = d.data() + (size_t(i) * T + j) * ic;
+              if (iy < 0 || iy >= g_.in_h || ix < 0 || ix >= g_.in_w) {
+                std::fill(dst, dst + ic, 0.0f);
+              } else {
+                std::copy_n(in_n + (size_t(iy) * g_.in_w + ix) * ic, ic, dst);
+              }
+            }
+          }
+          // V = B^T d B, then one product over the input channels per tile element
+          detail::Sandwich(W::BT, d.data(), W::BT, ic, tmp.data(), v.data());
+          std::fill(m.begin(), m.end(), 0.0f);
+          for (int e = 0; e < T * T; ++e) {
+            const float *ve = v.data() + e * ic;
+            const float *ue = packed_.data() + e * ic * oc;
+            float *me = m.data() + e * oc;
+            for (size_t c = 0; c < ic; ++c) {
+              const float x = ve[c];
+              const float *uc = ue + c * oc;
+              for (size_t o = 0; o < oc; ++o) {
+                me[o] += x * uc[o];
+              }
+            }
+          }
+          // Y = A^T m A, clipped at the bottom and right borders
+          detail::Sandwich(W::AT, m.data(), W::AT, oc, tmp.data(), y.data());
+          for (int i = 0; i < M && ty * M + i < g_.out_h; ++i) {
+            for (int j = 0; j < M && tx * M + j < g_.out_w; ++j) {
+              std::copy_n(y.data() + (size_t(i) * M + j) * oc, oc,
+                          out_n + (size_t(ty * M + i) * g_.out_w + tx * M + j) * oc);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  Conv2dGeometry g_;
+  WinogradMode mode_{WinogradMode::OFF};
+  size_t k_{0};
+  std::vector<float> packed_;
+};
+
+}  // namespace kernels
+}  // namespace mera
+
+#endif  // MDNA_KERNELS_CONV2D_H
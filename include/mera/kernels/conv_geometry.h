@@ -0,0 +1,115 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_KERNELS_CONV_GEOMETRY_H
+#define MDNA_KERNELS_CONV_GEOMETRY_H
+
+#include <stdexcept>
+#include <string>
+
+#include "../mdna_ir.h"
+
+namespace mera {
+namespace kernels {
+
+/**
+ * @brief Sizes and attributes of a 2D convolution, shared by all host convolution kernels. Activations are NHWC
+ * and weights OIHW, with I the input channels of one group, for transposed convolutions too (see ir::TransConv2d).
+ */
+struct Conv2dGeometry {
+  int batch;
+  int in_h, in_w, in_c;
+  int out_h, out_w, out_c;
+  int k_h, k_w;
+  int groups;
+  ir::Strides strides;
+  ir::Dilations dilations;
+  ir::Padding padding;
+  bool transposed;
+
+  int InChannelsPerGroup() const { return in_c / groups; }
+  int OutChannelsPerGroup() const { return out_c / groups; }
+
+  // Same classification as Conv2d / QuantizedConv2d in mdna_ir.h
+  bool IsDepthwiseConv() const { return groups > 1 && groups == out_c && InChannelsPerGroup() == 1; }
+  bool IsGroupConv() const { return groups > 1 && !IsDepthwiseConv(); }
+  bool IsPointwiseConv() const { return groups == 1; }
+
+  bool Is1x1Unpadded() const {
+    return k_h == 1 && k_w == 1 && padding.top == 0 && padding.bottom == 0 && padding.left == 0 &&
+           padding.right == 0;
+  }
+
+  /**
+   * @brief Input row feeding kernel row 'ky' of output row 'oy', or -1 when the tap falls into padding or, for
+   * transposed convolutions, between strides. SourceX() is the same for columns.
+   */
+  int SourceY(int oy, int ky) const { return Source(oy, ky, strides.h, dilations.h, padding.top, in_h); }
+  int SourceX(int ox, int kx) const { return Source(ox, kx, strides.w, dilations.w, padding.left, in_w); }
+
+  template <typename Op>
+  static Conv2dGeometry Of(const Op &op, bool transposed) {
+    const auto &in = op.input.shape;
+    const auto &out = op.output.shape;
+    const auto &w = op.weight.shape;
+    if (!(in.layout == ir::layout::NHWC) || !(out.layout == ir::layout::NHWC)) {
+      throw std::runtime_error("Host convolution kernels need NHWC activations, got " + in.layout.AsStr());
+    }
+    if (w.rank != 4 || op.groups <= 0 || w.shape[0] != out.DimOf('C') || w.shape[1] * op.groups != in.DimOf('C')) {
+      throw std::runtime_error("Weights are not OIHW with O = " + std::to_string(out.DimOf('C')) + " and I = " +
+                               std::to_string(in.DimOf('C')) + " / " + std::to_string(op.groups) + " groups");
+    }
+    Conv2dGeometry g{in.DimOf('N'), in.DimOf('H'), in.DimOf('W'), in.DimOf('C'),
+                     out.DimOf('H'), out.DimOf('W'), out.DimOf('C'),
+                     op.weight.shape.DimOf('H'), op.weight.shape.DimOf('W'),
+                     op.groups, op.strides, op.dilations, op.padding, transposed};
+    g.Validate();
+    return g;
+  }
+
+  void Validate() const {
+    if (groups <= 0 || in_c % groups != 0 || out_c % groups != 0) {
+      throw std::runtime_error("Channels (" + std::to_string(in_c) + ", " + std::to_string(out_c) +
+                               ") not divisible by groups " + std::to_string(groups));
+    }
+    if (strides.h <= 0 || strides.w <= 0 || dilations.h <= 0 || dilations.w <= 0) {
+      throw std::runtime_error("Strides and dilations must be positive");
+    }
+  }
+
+ private:
+  int Source(int o, int k, int stride, int dilation, int pad_before, int in_size) const {
+    if (!transposed) {
+      const int i = o * stride - pad_before + k * dilation;
+      return i >= 0 && i < in_size ? i : -1;
+    }
+    const int num = o + pad_before - k * dilation;
+    if (num < 0 || num % stride != 0) {
+      return -1;
+    }
+    const int i = num / stride;
+    return i < in_size ? i : -1;
+  }
+};
+
+inline Conv2dGeometry GeometryOf(const ir::Conv2d &op) { return Conv2dGeometry::Of(op, false); }
+inline Conv2dGeometry GeometryOf(const ir::QuantizedConv2d &op) { return Conv2dGeometry::Of(op, false); }
+inline Conv2dGeometry GeometryOf(const ir::TransConv2d &op) { return Conv2dGeometry::Of(op, true); }
+inline Conv2dGeometry GeometryOf(const ir::QuantizedTransConv2d &op) { return Conv2dGeometry::Of(op, true); }
+
+}  // namespace kernels
+}  // namespace mera
+
+#endif  // MDNA_KERNELS_CONV_GEOMETRY_H
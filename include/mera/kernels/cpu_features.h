@@ -0,0 +1,118 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_KERNELS_CPU_FEATURES_H
+#define MDNA_KERNELS_CPU_FEATURES_H
+
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#if defined(__aarch64__) && defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
+namespace mera {
+namespace kernels {
+
+/**
+ * @brief Instruction sets the host kernels are specialized for, from least to most capable.
+ */
+enum class Isa { SCALAR, NEON, NEON_DOTPROD, AVX2, AVX512_VNNI };
+
+inline std::string ToString(Isa isa) {
+  static const char *names[] = {"scalar", "neon", "neon_dotprod", "avx2", "avx512_vnni"};
+  return names[int(isa)];
+}
+
+/**
+ * @brief CPU features of the host, detected once at runtime.
+ */
+struct CpuFeatures {
+  bool avx2{false};
+  bool avx512_vnni{false};
+  bool neon{false};
+  // Armv8.2 sdot/udot
+  bool neon_dotprod{false};
+
+  static const CpuFeatures &Host() {
+    static const CpuFeatures f = Detect();
+    return f;
+  }
+
+  bool Supports(Isa isa) const {
+    switch (isa) {
+      case Isa::SCALAR: return true;
+      case Isa::NEON: return neon;
+      case Isa::NEON_DOTPROD: return neon_dotprod;
+      case Isa::AVX2: return avx2;
+      case Isa::AVX512_VNNI: return avx512_vnni;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Most capable supported instruction set. The environment variable MERA_HOST_ISA caps it, e.g.
+   * MERA_HOST_ISA=scalar forces the portable kernels.
+   */
+  Isa BestIsa() const {
+    Isa cap = Isa::AVX512_VNNI;
+    if (const char *env = std::getenv("MERA_HOST_ISA")) {
+      cap = ParseIsa(env);
+    }
+    for (const Isa isa : {Isa::AVX512_VNNI, Isa::AVX2, Isa::NEON_DOTPROD, Isa::NEON}) {
+      if (int(isa) <= int(cap) && Supports(isa)) {
+        return isa;
+      }
+    }
+    return Isa::SCALAR;
+  }
+
+  static Isa ParseIsa(const std::string &name) {
+    for (const Isa isa : {Isa::SCALAR, Isa::NEON, Isa::NEON_DOTPROD, Isa::AVX2, Isa::AVX512_VNNI}) {
+      if (name == ToString(isa)) {
+        return isa;
+      }
+    }
+    throw std::runtime_error("Unknown instruction set '" + name + "'");
+  }
+
+ private:
+  static CpuFeatures Detect() {
+    CpuFeatures f;
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    // Every AVX2 kernel also relies on FMA
+    f.avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    f.avx512_vnni = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+                    __builtin_cpu_supports("avx512vnni");
+#elif defined(__aarch64__)
+    // Advanced SIMD is mandatory on AArch64
+    f.neon = true;
+#if defined(__linux__)
+    f.neon_dotprod = (::getauxval(AT_HWCAP) & HWCAP_ASIMDDP) != 0;
+#elif defined(__ARM_FEATURE_DOTPROD)
+    f.neon_dotprod = true;
+#endif
+#endif
+    return f;
+  }
+};
+
+}  // namespace kernels
+}  // namespace mera
+
+#endif  // MDNA_KERNELS_CPU_FEATURES_H
@@ -0,0 +1,724 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_KERNELS_GEMM_H
+#define MDNA_KERNELS_GEMM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "bf16.h"
+#include "cpu_features.h"
+
+/**
+ * @file gemm.h
+ * @brief Cache blocked GEMM with prepacked constant operands, the host kernel of Fc and MatMul.
+ *
+ * C[M x N] = A[M x K] * B[K x N], all row major. B is the constant operand (weights) and is packed once at
+ * construction into panels of NR columns. Each Run() packs blocks of MC x KC of A into panels of MR rows and
+ * computes MR x NR tiles of C with a register blocked micro-kernel, following the BLIS loop nest. The blocks of C
+ * run on a process wide pool of worker threads.
+ */
+namespace mera {
+namespace kernels {
+
+/**
+ * @brief Storage order of the constant operand. NK is the [out_features][in_features] order of Fc weights.
+ */
+enum class BLayout { KN, NK };
+
+struct GemmOptions {
+  // Threads splitting the blocks of C, the calling one included. 0 uses std::thread::hardware_concurrency().
+  // Helpers come from a process wide pool of unpinned threads, so keep 1 inside execute::ExecutorPool replicas,
+  // which already run one per core set and pin their threads
+  unsigned num_threads{1};
+  Isa isa{CpuFeatures::Host().BestIsa()};
+};
+
+namespace detail {
+
+// Cache blocking: KC rows of a B panel stay in L1, an MC x KC block of A in L2, NC columns of B in L3
+constexpr size_t kGemmKC = 256;
+constexpr size_t kGemmMC = 96;
+constexpr size_t kGemmNC = 1024;
+
+/**
+ * @brief Shape of a micro-kernel and the k interleave of its packed operands: 'group' consecutive k values of one
+ * row or column are stored together, so a single instruction consumes them.
+ */
+struct GemmTile {
+  size_t mr;
+  size_t nr;
+  size_t group;
+};
+
+inline size_t RoundUp(size_t v, size_t m) { return (v + m - 1) / m * m; }
+
+/**
+ * @brief Packs columns [0, N) of 'get(k, n)' into panels of nr columns: [panel][k / group][nr][group].
+ */
+template <typename T, typename Get>
+std::vector<T> PackB(size_t K, size_t N, const GemmTile &t, Get get) {
+  const size_t k_pad = RoundUp(K, t.group);
+  const size_t panels = (N + t.nr - 1) / t.nr;
+  std::vector<T> packed(panels * k_pad * t.nr, T(0));
+  for (size_t p = 0; p < panels; ++p) {
+    T *dst = packed.data() + p * k_pad * t.nr;
+    for (size_t k = 0; k < K; ++k) {
+      for (size_t j = 0; j < t.nr && p * t.nr + j < N; ++j) {
+        dst[((k / t.group) * t.nr + j) * t.group + k % t.group] = get(k, p * t.nr + j);
+      }
+    }
+  }
+  return packed;
+}
+
+/**
+ * @brief Packs rows [m0, m0 + mc) and columns [k0, k0 + kc) of row major 'a' into panels of mr rows:
+ * [panel][kc / group][mr][group]. Rows past M and columns past K are zero.
+ */
+template <typename T, typename S, typename Convert>
+void PackA(const S *a, size_t M, size_t K, size_t m0, size_t mc, size_t k0, size_t kc, const GemmTile &t, T *dst,
+           Convert convert) {
+  const size_t panels = (mc + t.mr - 1) / t.mr;
+  std::fill(dst, dst + panels * t.mr * kc, T(0));
+  for (size_t p = 0; p < panels; ++p) {
+    T *panel = dst + p * t.mr * kc;
+    for (size_t r = 0; r < t.mr; ++r) {
+      const size_t m = m0 + p * t.mr + r;
+      if (m >= M || m >= m0 + mc) {
+        break;
+      }
+      const S *row = a + m * K;
+      for (size_t k = 0; k < kc && k0 + k < K; ++k) {
+        panel[((k / t.group) * t.mr + r) * t.group + k % t.group] = convert(row[k0 + k]);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Worker threads shared by every GEMM of the process, started on first use. They are not pinned to any
+ * core. ParallelFor() may be called concurrently from any number of threads.
+ */
+class GemmThreadPool {
+ public:
+  static GemmThreadPool &Global() {
+    static GemmThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+  }
+
+  explicit GemmThreadPool(unsigned workers) {
+    for (unsigned i = 0; i < workers; ++i) {
+      threads_.emplace_back([this] { Work(); });
+    }
+  }
+
+  ~GemmThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto &t : threads_) {
+      t.join();
+    }
+  }
+
+  /**
+   * @brief Runs 'fn' on the calling thread and on up to 'threads' - 1 workers, and returns once every started run
+   * has returned. 'fn' is expected to share its work through an atomic counter: once the caller's own run returns
+   * the work is done, so helpers that have not started yet, e.g. because the workers are busy with the GEMMs of
+   * other callers, are skipped instead of waited for. A call made from inside 'fn', on the caller or on a worker,
+   * runs 'fn' on the calling thread only.
+   */
+  void ParallelFor(unsigned threads, const std::function<void()> &fn) {
+    const unsigned helpers = std::min<unsigned>(threads - 1, unsigned(threads_.size()));
+    if (helpers == 0 || InParallelFor()) {
+      fn();
+      return;
+    }
+    auto job = std::make_shared<Job>();
+    job->fn = &fn;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (unsigned i = 0; i < helpers; ++i) {
+        tasks_.push_back(job);
+      }
+    }
+    cv_.notify_all();
+    {
+      InParallelFor() = true;
+      struct Reset {
+        ~Reset() { InParallelFor() = false; }
+      } reset;
+      fn();
+    }
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->closed = true;
+    job->cv.wait(lock, [&] { return job->running == 0; });
+  }
+
+ private:
+  /**
+   * @brief One ParallelFor() call. Its queued entries outlive the call when they were skipped, so 'fn' may only be
+   * used by runs that started before 'closed' was set.
+   */
+  struct Job {
+    const std::function<void()> *fn{nullptr};
+    std::mutex mutex;
+    std::condition_variable cv;
+    unsigned running{0};
+    bool closed{false};
+  };
+
+  static bool &InParallelFor() {
+    thread_local bool inside = false;
+    return inside;
+  }
+
+  void Work() {
+    // Workers only ever run inside a ParallelFor()
+    InParallelFor() = true;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      cv_.wait(lock, [&] { return stop_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return;
+      }
+      auto job = std::move(tasks_.front());
+      tasks_.pop_front();
+      lock.unlock();
+      Run(*job);
+      job.reset();
+      lock.lock();
+    }
+  }
+
+  static void Run(Job &job) {
+    {
+      std::lock_guard<std::mutex> lock(job.mutex);
+      if (job.closed) {
+        return;
+      }
+      ++job.running;
+    }
+    (*job.fn)();
+    std::lock_guard<std::mutex> lock(job.mutex);
+    if (--job.running == 0 && job.closed) {
+      job.cv.notify_one();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::shared_ptr<Job>> tasks_;
+  std::vector<std::thread> threads_;
+  bool stop_{false};
+};
+
+/**
+ * @brief BLIS style loop nest over the blocks of C. Jobs of up to MC x NC are shared among the threads; within a
+ * job A is packed one KC slice at a time and every MR x NR tile goes through 'ukr' into C. When M is too small to
+ * give every thread a block of rows, as for Fc at small batch sizes, N is cut into narrower jobs of whole NR
+ * panels instead.
+ */
+template <typename AElem, typename BElem, typename Acc, typename PackAFn, typename Ukr>
+void RunBlocked(size_t M, size_t N, size_t K, const GemmTile &t, const BElem *packed_b, PackAFn pack_a, Ukr ukr,
+                Acc *c, unsigned num_threads) {
+  const size_t k_pad = RoundUp(K, t.group);
+  const size_t mc_max = RoundUp(kGemmMC, t.mr);
+  const size_t m_jobs = (M + mc_max - 1) / mc_max;
+  const size_t n_split = std::max<size_t>(1, num_threads / m_jobs);
+  const size_t nc_max = std::min(RoundUp(kGemmNC, t.nr), RoundUp((N + n_split - 1) / n_split, t.nr));
+  const size_t n_jobs = (N + nc_max - 1) / nc_max;
+  const size_t jobs = m_jobs * n_jobs;
+  std::atomic<size_t> next{0};
+
+  auto work = [&] {
+    std::vector<AElem> a_block(mc_max * kGemmKC);
+    std::vector<Acc> tile(t.mr * t.nr);
+    for (size_t job = next++; job < jobs; job = next++) {
+      const size_t m0 = (job / n_jobs) * mc_max;
+      const size_t n0 = (job % n_jobs) * nc_max;
+      const size_t mc = std::min(mc_max, M - m0);
+      const size_t nc = std::min(nc_max, N - n0);
+      for (size_t k0 = 0; k0 < k_pad; k0 += kGemmKC) {
+        const size_t kc = std::min(kGemmKC, k_pad - k0);
+        pack_a(m0, mc, k0, kc, a_block.data());
+        for (size_t nt = 0; nt < nc; nt += t.nr) {
+          const BElem *b_panel = packed_b + ((n0 + nt) / t.nr) * k_pad * t.nr + k0 * t.nr;
+          for (size_t mt = 0; mt < mc; mt += t.mr) {
+            ukr(a_block.data() + (mt / t.mr) * t.mr * kc, b_panel, kc, tile.data());
+            const size_t rows = std::min(t.mr, mc - mt);
+            const size_t cols = std::min(t.nr, nc - nt);
+            for (size_t r = 0; r < rows; ++r) {
+              Acc *dst = c + (m0 + mt + r) * N + n0 + nt;
+              const Acc *src = tile.data() + r * t.nr;
+              if (k0 == 0) {
+                std::copy_n(src, cols, dst);
+              } else {
+                for (size_t j = 0; j < cols; ++j) {
+                  dst[j] += src[j];
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  };
+
+  const unsigned threads = unsigned(std::max<size_t>(1, std::min<size_t>(num_threads, jobs)));
+  GemmThreadPool::Global().ParallelFor(threads, work);
+}
+
+// Portable micro-kernels, written so the compiler can vectorize over the tile columns
+
+template <typename A, typename B, typename Acc>
+void UkrScalar(const A *a, const B *b, size_t kc, const GemmTile &t, Acc *tile) {
+  std::fill(tile, tile + t.mr * t.nr, Acc(0));
+  for (size_t kg = 0; kg < kc / t.group; ++kg) {
+    for (size_t r = 0; r < t.mr; ++r) {
+      for (size_t g = 0; g < t.group; ++g) {
+        const Acc av = Acc(a[(kg * t.mr + r) * t.group + g]);
+        const B *bk = b + kg * t.nr * t.group + g;
+        Acc *row = tile + r * t.nr;
+        for (size_t j = 0; j < t.nr; ++j) {
+          row[j] += av * Acc(bk[j * t.group]);
+        }
+      }
+    }
+  }
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+
+// int8: 8 x 16 tile, k in quads of u8 (A, offset by 128) times s8 (B)
+__attribute__((target("avx512f,avx512bw,avx512vnni"))) inline void UkrS8Vnni(const uint8_t *a, const int8_t *b,
+                                                                            size_t kc, int32_t *tile) {
+  __m512i acc[8];
+  for (auto &v : acc) { v = _mm512_setzero_si512(); }
+  for (size_t kq = 0; kq < kc / 4; ++kq) {
+    const __m512i bv = _mm512_loadu_si512(b + kq * 64);
+    const uint8_t *ak = a + kq * 32;
+    for (int r = 0; r < 8; ++r) {
+      int32_t quad;
+      std::memcpy(&quad, ak + r * 4, 4);
+      acc[r] = _mm512_dpbusd_epi32(acc[r], _mm512_set1_epi32(quad), bv);
+    }
+  }
+  for (int r = 0; r < 8; ++r) {
+    _mm512_storeu_si512(tile + r * 16, acc[r]);
+  }
+}
+
+// int8 widened to int16: 4 x 16 tile, k in pairs
+__attribute__((target("avx2"))) inline void UkrS16Avx2(const int16_t *a, const int16_t *b, size_t kc,
+                                                       int32_t *tile) {
+  __m256i acc[4][2];
+  for (auto &row : acc) { row[0] = row[1] = _mm256_setzero_si256(); }
+  for (size_t kp = 0; kp < kc / 2; ++kp) {
+    const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + kp * 32));
+    const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + kp * 32 + 16));
+    const int16_t *ak = a + kp * 8;
+    for (int r = 0; r < 4; ++r) {
+      int32_t pair;
+      std::memcpy(&pair, ak + r * 2, 4);
+      const __m256i av = _mm256_set1_epi32(pair);
+      acc[r][0] = _mm256_add_epi32(acc[r][0], _mm256_madd_epi16(av, b0));
+      acc[r][1] = _mm256_add_epi32(acc[r][1], _mm256_madd_epi16(av, b1));
+    }
+  }
+  for (int r = 0; r < 4; ++r) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(tile + r * 16), acc[r][0]);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(tile + r * 16 + 8), acc[r][1]);
+  }
+}
+
+// fp32: 6 x 32 tile
+__attribute__((target("avx512f"))) inline void UkrF32Avx512(const float *a, const float *b, size_t kc,
+                                                            float *tile) {
+  __m512 acc[6][2];
+  for (auto &row : acc) { row[0] = row[1] = _mm512_setzero_ps(); }
+  for (size_t k = 0; k < kc; ++k) {
+    const __m512 b0 = _mm512_loadu_ps(b + k * 32);
+    const __m512 b1 = _mm512_loadu_ps(b + k * 32 + 16);
+    for (int r = 0; r < 6; ++r) {
+      const __m512 av = _mm512_set1_ps(a[k * 6 + r]);
+      acc[r][0] = _mm512_fmadd_ps(av, b0, acc[r][0]);
+      acc[r][1] = _mm512_fmadd_ps(av, b1, acc[r][1]);
+    }
+  }
+  for (int r = 0; r < 6; ++r) {
+    _mm512_storeu_ps(tile + r * 32, acc[r][0]);
+    _mm512_storeu_ps(tile + r * 32 + 16, acc[r][1]);
+  }
+}
+
+// fp32: 6 x 16 tile
+__attribute__((target("avx2,fma"))) inline void UkrF32Avx2(const float *a, const float *b, size_t kc,
+                                                           float *tile) {
+  __m256 acc[6][2];
+  for (auto &row : acc) { row[0] = row[1] = _mm256_setzero_ps(); }
+  for (size_t k = 0; k < kc; ++k) {
+    const __m256 b0 = _mm256_loadu_ps(b + k * 16);
+    const __m256 b1 = _mm256_loadu_ps(b + k * 16 + 8);
+    for (int r = 0; r < 6; ++r) {
+      const __m256 av = _mm256_broadcast_ss(a + k * 6 + r);
+      acc[r][0] = _mm256_fmadd_ps(av, b0, acc[r][0]);
+      acc[r][1] = _mm256_fmadd_ps(av, b1, acc[r][1]);
+    }
+  }
+  for (int r = 0; r < 6; ++r) {
+    _mm256_storeu_ps(tile + r * 16, acc[r][0]);
+    _mm256_storeu_ps(tile + r * 16 + 8, acc[r][1]);
+  }
+}
+
+#endif  // __x86_64__
+
+#if defined(__aarch64__)
+
+// fp32: 8 x 8 tile
+inline void UkrF32Neon(const float *a, const float *b, size_t kc, float *tile) {
+  float32x4_t acc[8][2];
+  for (auto &row : acc) { row[0] = row[1] = vdupq_n_f32(0.0f); }
+  for (size_t k = 0; k < kc; ++k) {
+    const float32x4_t b0 = vld1q_f32(b + k * 8);
+    const float32x4_t b1 = vld1q_f32(b + k * 8 + 4);
+    for (int r = 0; r < 8; ++r) {
+      acc[r][0] = vfmaq_n_f32(acc[r][0], b0, a[k * 8 + r]);
+      acc[r][1] = vfmaq_n_f32(acc[r][1], b1, a[k * 8 + r]);
+    }
+  }
+  for (int r = 0; r < 8; ++r) {
+    vst1q_f32(tile + r * 8, acc[r][0]);
+    vst1q_f32(tile + r * 8 + 4, acc[r][1]);
+  }
+}
+
+// int8 widened to int16: 4 x 16 tile, one k at a time
+inline void UkrS16Neon(const int16_t *a, const int16_t *b, size_t kc, int32_t *tile) {
+  int32x4_t acc[4][4];
+  for (auto &row : acc) { row[0] = row[1] = row[2] = row[3] = vdupq_n_s32(0); }
+  for (size_t k = 0; k < kc; ++k) {
+    const int16x8_t b0 = vld1q_s16(b + k * 16);
+    const int16x8_t b1 = vld1q_s16(b + k * 16 + 8);
+    for (int r = 0; r < 4; ++r) {
+      const int16_t av = a[k * 4 + r];
+      acc[r][0] = vmlal_n_s16(acc[r][0], vget_low_s16(b0), av);
+      acc[r][1] = vmlal_n_s16(acc[r][1], vget_high_s16(b0), av);
+      acc[r][2] = vmlal_n_s16(acc[r][2], vget_low_s16(b1), av);
+      acc[r][3] = vmlal_n_s16(acc[r][3], vget_high_s16(b1), av);
+    }
+  }
+  for (int r = 0; r < 4; ++r) {
+    for (int q = 0; q < 4; ++q) {
+      vst1q_s32(tile + r * 16 + q * 4, acc[r][q]);
+    }
+  }
+}
+
+#if defined(__clang__)
+#define MERA_TARGET_DOTPROD __attribute__((target("dotprod")))
+#else
+#define MERA_TARGET_DOTPROD __attribute__((target("+dotprod")))
+#endif
+
+// int8: 8 x 8 tile, k in quads of s8 times s8 with sdot
+MERA_TARGET_DOTPROD inline void UkrS8NeonDot(const int8_t *a, const int8_t *b, size_t kc, int32_t *tile) {
+  int32x4_t acc[8][2];
+  for (auto &row : acc) { row[0] = row[1] = vdupq_n_s32(0); }
+  for (size_t kq = 0; kq < kc / 4; ++kq) {
+    const int8x16_t b0 = vld1q_s8(b + kq * 32);
+    const int8x16_t b1 = vld1q_s8(b + kq * 32 + 16);
+    const int8_t *ak = a + kq * 32;
+    for (int r = 0; r < 8; ++r) {
+      int32_t quad;
+      std::memcpy(&quad, ak + r * 4, 4);
+      const int8x16_t av = vreinterpretq_s8_s32(vdupq_n_s32(quad));
+      acc[r][0] = vdotq_s32(acc[r][0], b0, av);
+      acc[r][1] = vdotq_s32(acc[r][1], b1, av);
+    }
+  }
+  for (int r = 0; r < 8; ++r) {
+    vst1q_s32(tile + r * 8, acc[r][0]);
+    vst1q_s32(tile + r * 8 + 4, acc[r][1]);
+  }
+}
+
+#undef MERA_TARGET_DOTPROD
+
+#endif  // __aarch64__
+
+inline unsigned ResolveThreads(unsigned n) { return n == 0 ? std::max(1u, std::thread::hardware_concurrency()) : n; }
+
+}  // namespace detail
+
+/**
+ * @brief Quantized GEMM: C[m][n] = sum_k (A[m][k] - a_zp) * (B[k][n] - b_zp[n]) + bias[n], int8 inputs and int32
+ * output, as needed by Fc. The raw products are accumulated without zero points and corrected afterwards:
+ * every term that only depends on B (its column sums, the a_zp * b_zp term and the bias) is folded into one
+ * value per column at construction, leaving a single row sum of A per Run(). Run() is thread safe.
+ */
+class GemmS8 {
+ public:
+  /**
+   * @param b Constant operand, K x N or N x K depending on 'layout'.
+   * @param b_zero_points One per column of C, or a single per tensor value.
+   * @param bias N values, or nullptr.
+   */
+  GemmS8(size_t K, size_t N, const int8_t *b, BLayout layout, int32_t a_zero_point,
+         const std::vector<int32_t> &b_zero_points, const int32_t *bias, GemmOptions opts = {}):
+    K_(K), N_(N), threads_(detail::ResolveThreads(opts.num_threads)) {
+    if (b_zero_points.size() != 1 && b_zero_points.size() != N) {
+      throw std::runtime_error("Expected 1 or " + std::to_string(N) + " zero points, got " +
+                               std::to_string(b_zero_points.size()));
+    }
+    auto get = [&](size_t k, size_t n) { return layout == BLayout::KN ? b[k * N + n] : b[n * K + k]; };
+    const CpuFeatures &host = CpuFeatures::Host();
+    if (opts.isa == Isa::AVX512_VNNI && host.Supports(Isa::AVX512_VNNI)) {
+      path_ = Path::kVnni;
+    } else if (opts.isa == Isa::NEON_DOTPROD && host.Supports(Isa::NEON_DOTPROD)) {
+      path_ = Path::kNeonDot;
+    } else if (int(opts.isa) >= int(Isa::AVX2) && host.Supports(Isa::AVX2)) {
+      path_ = Path::kAvx2;
+    } else if (int(opts.isa) >= int(Isa::NEON) && host.Supports(Isa::NEON)) {
+      path_ = Path::kNeon;
+    }
+    switch (path_) {
+      case Path::kVnni: tile_ = {8, 16, 4}; break;
+      case Path::kNeonDot: tile_ = {8, 8, 4}; break;
+      case Path::kNeon: tile_ = {4, 16, 1}; break;
+      default: tile_ = {4, 16, 2}; break;
+    }
+    if (path_ == Path::kVnni || path_ == Path::kNeonDot) {
+      packed_s8_ = detail::PackB<int8_t>(K, N, tile_, get);
+    } else {
+      packed_s16_ = detail::PackB<int16_t>(K, N, tile_, [&](size_t k, size_t n) { return int16_t(get(k, n)); });
+    }
+    b_zp_.resize(N);
+    col_term_.resize(N);
+    for (size_t n = 0; n < N; ++n) {
+      const int32_t zb = b_zero_points.size() == 1 ? b_zero_points[0] : b_zero_points[n];
+      int32_t col_sum = 0;
+      for (size_t k = 0; k < K; ++k) {
+        col_sum += get(k, n);
+      }
+      b_zp_[n] = zb;
+      // The VNNI path sees A + 128, which adds 128 * col_sum to every raw product
+      col_term_[n] = (bias ? bias[n] : 0) - a_zero_point * col_sum + int32_t(K) * a_zero_point * zb -
+                     (path_ == Path::kVnni ? 128 * col_sum : 0);
+    }
+  }
+
+  /**
+   * @param a M x K int8.
+   * @param c M x N int32.
+   */
+  void Run(const int8_t *a, size_t M, int32_t *c) const {
+    auto pack_a = [&](auto convert) {
+      return [&, convert](size_t m0, size_t mc, size_t k0, size_t kc, auto *dst) {
+        detail::PackA(a, M, K_, m0, mc, k0, kc, tile_, dst, convert);
+      };
+    };
+    const detail::GemmTile tile = tile_;
+    switch (path_) {
+      case Path::kVnni:
+        detail::RunBlocked<uint8_t>(M, N_, K_, tile_, packed_s8_.data(),
+          pack_a([](int8_t v) { return uint8_t(v ^ 0x80); }),
+          [tile](const uint8_t *ap, const int8_t *bp, size_t kc, int32_t *t) {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+            detail::UkrS8Vnni(ap, bp, kc, t);
+#else
+            detail::UkrScalar(ap, bp, kc, tile, t);
+#endif
+          }, c, threads_);
+        break;
+      case Path::kNeonDot:
+        detail::RunBlocked<int8_t>(M, N_, K_, tile_, packed_s8_.data(), pack_a([](int8_t v) { return v; }),
+          [tile](const int8_t *ap, const int8_t *bp, size_t kc, int32_t *t) {
+#if defined(__aarch64__)
+            detail::UkrS8NeonDot(ap, bp, kc, t);
+#else
+            detail::UkrScalar(ap, bp, kc, tile, t);
+#endif
+          }, c, threads_);
+        break;
+      default: {
+        const Path path = path_;
+        detail::RunBlocked<int16_t>(M, N_, K_, tile_, packed_s16_.data(), pack_a([](int8_t v) { return int16_t(v); }),
+          [path, tile](const int16_t *ap, const int16_t *bp, size_t kc, int32_t *t) {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+            if (path == Path::kAvx2) {
+              detail::UkrS16Avx2(ap, bp, kc, t);
+              return;
+            }
+#elif defined(__aarch64__)
+            if (path == Path::kNeon) {
+              detail::UkrS16Neon(ap, bp, kc, t);
+              return;
+            }
+#endif
+            detail::UkrScalar(ap, bp, kc, tile, t);
+          }, c, threads_);
+        break;
+      }
+    }
+    for (size_t m = 0; m < M; ++m) {
+      int32_t row_sum = 0;
+      for (size_t k = 0; k < K_; ++k) {
+        row_sum += a[m * K_ + k];
+      }
+      int32_t *cm = c + m * N_;
+      for (size_t n = 0; n < N_; ++n) {
+        cm[n] += col_term_[n] - b_zp_[n] * row_sum;
+      }
+    }
+  }
+
+ private:
+  // Micro-kernel family: int8 quads on VNNI (A offset to u8) or sdot, int16 pairs on AVX2, int16 on NEON
+  enum class Path { kScalar, kAvx2, kVnni, kNeon, kNeonDot };
+
+  size_t K_, N_;
+  unsigned threads_;
+  Path path_{Path::kScalar};
+  detail::GemmTile tile_{};
+  std::vector<int8_t> packed_s8_;
+  std::vector<int16_t> packed_s16_;
+  std::vector<int32_t> b_zp_;
+  std::vector<int32_t> col_term_;
+};
+
+/**
+ * @brief Float GEMM: C = A * B + bias, fp32 or bf16 storage with fp32 accumulation. Run() is thread safe.
+ */
+class GemmF32 {
+ public:
+  /**
+   * @param b Constant operand, K x N or N x K depending on 'layout'.
+   * @param bias N values, or nullptr.
+   */
+  GemmF32(size_t K, size_t N, const float *b, BLayout layout, const float *bias, GemmOptions opts = {}):
+    GemmF32(K, N, opts, bias, [&](size_t k, size_t n) { return layout == BLayout::KN ? b[k * N + n] : b[n * K + k]; }) {}
+
+  GemmF32(size_t K, size_t N, const bf16_t *b, BLayout layout, const float *bias, GemmOptions opts = {}):
+    GemmF32(K, N, opts, bias, [&](size_t k, size_t n) {
+      return BF16ToFloat(layout == BLayout::KN ? b[k * N + n] : b[n * K + k]);
+    }) {}
+
+  /**
+   * @brief C = A * B for two activations, as in MatMul. B is packed on every call.
+   */
+  static void Multiply(const float *a, const float *b, size_t M, size_t K, size_t N, float *c, GemmOptions opts = {}) {
+    GemmF32(K, N, b, BLayout::KN, nullptr, opts).Run(a, M, c);
+  }
+
+  void Run(const float *a, size_t M, float *c) const {
+    RunImpl(a, M, c, [](float v) { return v; });
+  }
+
+  void Run(const bf16_t *a, size_t M, bf16_t *c) const {
+    std::vector<float> out(M * N_);
+    RunImpl(a, M, out.data(), [](bf16_t v) { return BF16ToFloat(v); });
+    FloatToBF16(out.data(), c, out.size());
+  }
+
+ private:
+  template <typename Get>
+  GemmF32(size_t K, size_t N, GemmOptions opts, const float *bias, Get get):
+    K_(K), N_(N), threads_(detail::ResolveThreads(opts.num_threads)) {
+    const CpuFeatures &host = CpuFeatures::Host();
+    const bool has_avx512 = opts.isa == Isa::AVX512_VNNI && host.Supports(Isa::AVX512_VNNI);
+    const bool has_avx2 = int(opts.isa) >= int(Isa::AVX2) && host.Supports(Isa::AVX2);
+    const bool has_neon = int(opts.isa) >= int(Isa::NEON) && host.Supports(Isa::NEON);
+    isa_ = has_avx512 ? Isa::AVX512_VNNI : has_avx2 ? Isa::AVX2 : has_neon ? Isa::NEON : Isa::SCALAR;
+    switch (isa_) {
+      case Isa::AVX512_VNNI: tile_ = {6, 32, 1}; break;
+      case Isa::AVX2: tile_ = {6, 16, 1}; break;
+      case Isa::NEON: tile_ = {8, 8, 1}; break;
+      default: tile_ = {4, 16, 1}; break;
+    }
+    packed_ = detail::PackB<float>(K, N, tile_, get);
+    if (bias) {
+      bias_.assign(bias, bias + N);
+    }
+  }
+
+  template <typename S, typename Convert>
+  void RunImpl(const S *a, size_t M, float *c, Convert convert) const {
+    const Isa isa = isa_;
+    const detail::GemmTile tile = tile_;
+    detail::RunBlocked<float>(M, N_, K_, tile_, packed_.data(),
+      [&](size_t m0, size_t mc, size_t k0, size_t kc, float *dst) {
+        detail::PackA(a, M, K_, m0, mc, k0, kc, tile_, dst, convert);
+      }, [isa, tile](const float *ap, const float *bp, size_t kc, float *t) {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+        if (isa == Isa::AVX512_VNNI) {
+          detail::UkrF32Avx512(ap, bp, kc, t);
+          return;
+        }
+        if (isa == Isa::AVX2) {
+          detail::UkrF32Avx2(ap, bp, kc, t);
+          return;
+        }
+#elif defined(__aarch64__)
+        if (isa == Isa::NEON) {
+          detail::UkrF32Neon(ap, bp, kc, t);
+          return;
+        }
+#endif
+        detail::UkrScalar(ap, bp, kc, tile, t);
+      }, c, threads_);
+    if (!bias_.empty()) {
+      for (size_t m = 0; m < M; ++m) {
+        for (size_t n = 0; n < N_; ++n) {
+          c[m * N_ + n] += bias_[n];
+        }
+      }
+    }
+  }
+
+  size_t K_, N_;
+  unsigned threads_;
+  Isa isa_{Isa::SCALAR};
+  detail::GemmTile tile_{};
+  std::vector<float> packed_;
+  std::vector<float> bias_;
+};
+
+}  // namespace kernels
+}  // namespace mera
+
+#endif  // MDNA_KERNELS_GEMM_H
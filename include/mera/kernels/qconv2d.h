@@ -0,0 +1,346 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_KERNELS_QCONV2D_H
+#define MDNA_KERNELS_QCONV2D_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../mdna_ir.h"
+#include "conv_geometry.h"
+#include "cpu_features.h"
+#include "gemm.h"
+#include "qdot.h"
+
+/**
+ * @file qconv2d.h
+ * @brief Host kernels of QuantizedConv2d and QuantizedTransConv2d.
+ *
+ * Activations are NHWC int8, weights OIHW int8 with I the input channels of one group, and the output holds the
+ * NHWC int32 accumulators sum((x - x_zp) * (w - w_zp)).
+ */
+namespace mera {
+namespace kernels {
+
+/**
+ * @brief Loop structure used for a convolution.
+ */
+enum class ConvAlgo {
+  // Per pixel patch gather and multi row dot product, grouped or not
+  GENERIC,
+  // Channel vectorized multiply-accumulate over the taps, one group per channel
+  DEPTHWISE,
+  // 1x1 convolution run as one packed GEMM of the pixels against the weights, see gemm.h
+  POINTWISE
+};
+
+inline ConvAlgo SelectConvAlgo(const Conv2dGeometry &g) {
+  if (g.transposed) {
+    return ConvAlgo::GENERIC;
+  }
+  if (g.IsDepthwiseConv()) {
+    return ConvAlgo::DEPTHWISE;
+  }
+  if (g.IsPointwiseConv() && g.Is1x1Unpadded()) {
+    return ConvAlgo::POINTWISE;
+  }
+  return ConvAlgo::GENERIC;
+}
+
+/**
+ * @brief Int8 convolution with weights packed once at construction, meant to be built when the executor is
+ * created and run for every inference. The loop structure is chosen by SelectConvAlgo(): in the generic case each
+ * output pixel gathers its receptive field into an int8 patch, then a single multi row int8 dot product against
+ * the packed weights of its group yields all of the group's output channels, so group convolutions run as one
+ * small GEMM per group. Zero points are applied afterwards from the patch sum and precomputed weight sums, so
+ * they may take any value. Scratch buffers are thread local and reused across calls. Run() is thread safe.
+ */
+class QConv2dKernel {
+ public:
+  /**
+   * @param weight OIHW int8 weights.
+   * @param weight_zero_points One per output channel, or a single per tensor value.
+   */
+  QConv2dKernel(const Conv2dGeometry &geom, const int8_t *weight, int32_t input_zero_point,
+                const std::vector<int32_t> &weight_zero_points, Isa isa = CpuFeatures::Host().BestIsa()):
+    g_(geom), input_zp_(input_zero_point), algo_(SelectConvAlgo(geom)), dot_(SelectQDot(isa)),
+    mac_(SelectQMac(isa)), isa_(CpuFeatures::Host().Supports(isa) ? isa : Isa::SCALAR) {
+    g_.Validate();
+    if (weight_zero_points.size() != 1 && weight_zero_points.size() != size_t(g_.out_c)) {
+      throw std::runtime_error("Expected 1 or " + std::to_string(g_.out_c) + " weight zero points, got " +
+                               std::to_string(weight_zero_points.size()));
+    }
+    if (algo_ == ConvAlgo::DEPTHWISE) {
+      PackDepthwise(weight, weight_zero_points);
+      return;
+    }
+    if (algo_ == ConvAlgo::POINTWISE) {
+      // OIHW weights of a 1x1 convolution are the [out_c][in_c] operand of the GEMM
+      gemm_ = std::make_shared<const GemmS8>(g_.in_c, g_.out_c, weight, BLayout::NK, input_zero_point,
+                                             weight_zero_points, nullptr, GemmOptions{1, isa_});
+      return;
+    }
+    if (input_zero_point < -128 || input_zero_point > 127) {
+      throw std::runtime_error("Input zero point " + std::to_string(input_zero_point) + " is not an int8 value");
+    }
+    const int icg = g_.InChannelsPerGroup();
+    k_ = size_t(g_.k_h) * g_.k_w * icg;
+    k_pad_ = (k_ + kQDotBlock - 1) / kQDotBlock * kQDotBlock;
+    // Row of output channel 'o' is laid out as [ky][kx][c] to match the NHWC patch, zero padded to k_pad_
+    packed_s8_.assign(size_t(g_.out_c) * k_pad_, 0);
+    w_sums_.assign(g_.out_c, 0);
+    w_zp_.resize(g_.out_c);
+    col_term_.resize(g_.out_c);
+    for (int o = 0; o < g_.out_c; ++o) {
+      const int32_t zp = weight_zero_points.size() == 1 ? weight_zero_points[0] : weight_zero_points[o];
+      int8_t *row = packed_s8_.data() + size_t(o) * k_pad_;
+      for (int c = 0; c < icg; ++c) {
+        for (int ky = 0; ky < g_.k_h; ++ky) {
+          for (int kx = 0; kx < g_.k_w; ++kx) {
+            const int8_t w = weight[((size_t(o) * icg + c) * g_.k_h + ky) * g_.k_w + kx];
+            row[(size_t(ky) * g_.k_w + kx) * icg + c] = w;
+            w_sums_[o] += w;
+          }
+        }
+      }
+      // sum (x - x_zp) * (w - w_zp) = sum x * w - w_zp * sum x - x_zp * sum w + k * x_zp * w_zp
+      w_zp_[o] = zp;
+      col_term_[o] = int32_t(k_) * input_zero_point * zp - input_zero_point * w_sums_[o];
+    }
+  }
+
+  Isa isa() const { return isa_; }
+  ConvAlgo algo() const { return algo_; }
+
+  /**
+   * @param input NHWC int8 activations.
+   * @param output NHWC int32 accumulators.
+   */
+  void Run(const int8_t *input, int32_t *output) const {
+    if (algo_ == ConvAlgo::DEPTHWISE) {
+      RunDepthwise(input, output);
+      return;
+    }
+    if (algo_ == ConvAlgo::POINTWISE) {
+      RunPointwise(input, output);
+      return;
+    }
+    const int icg = g_.InChannelsPerGroup();
+    const int ocg = g_.OutChannelsPerGroup();
+    thread_local std::vector<int8_t> patch;
+    patch.assign(k_pad_, 0);
+    for (int n = 0; n < g_.batch; ++n) {
+      const int8_t *in_n = input + size_t(n) * g_.in_h * g_.in_w * g_.in_c;
+      for (int oy = 0; oy < g_.out_h; ++oy) {
+        for (int ox = 0; ox < g_.out_w; ++ox) {
+          int32_t *out = output + ((size_t(n) * g_.out_h + oy) * g_.out_w + ox) * g_.out_c;
+          for (int grp = 0; grp < g_.groups; ++grp) {
+            Gather(in_n, oy, ox, grp * icg, patch.data());
+            Dot(patch.data(), grp * ocg, ocg, out + grp * ocg);
+          }
+        }
+      }
+    }
+  }
+
+ private:
+  // Weights as [ky][kx][c] rows of c_pad_ channels, so every tap is one vector multiply-accumulate over channels
+  void PackDepthwise(const int8_t *weight, const std::vector<int32_t> &weight_zero_points) {
+    c_pad_ = (size_t(g_.out_c) + kQMacBlock - 1) / kQMacBlock * kQMacBlock;
+    packed_s16_.assign(size_t(g_.k_h) * g_.k_w * c_pad_, 0);
+    for (int c = 0; c < g_.out_c; ++c) {
+      const int32_t zp = weight_zero_points.size() == 1 ? weight_zero_points[0] : weight_zero_points[c];
+      for (int t = 0; t < g_.k_h * g_.k_w; ++t) {
+        packed_s16_[size_t(t) * c_pad_ + c] = int16_t(weight[size_t(c) * g_.k_h * g_.k_w + t] - zp);
+      }
+    }
+    std::vector<bool> used(g_.in_w, false);
+    for (int ox = 0; ox < g_.out_w; ++ox) {
+      for (int kx = 0; kx < g_.k_w; ++kx) {
+        const int ix = g_.SourceX(ox, kx);
+        if (ix >= 0) {
+          used[ix] = true;
+        }
+      }
+    }
+    for (int x = 0; x < g_.in_w; ++x) {
+      if (used[x]) {
+        used_cols_.push_back(x);
+      }
+    }
+  }
+
+  /**
+   * @brief Converts the columns of input row 'iy' that some tap reads to zero point corrected int16 pixels of
+   * c_pad_ channels.
+   */
+  void WidenRow(const int8_t *in_n, int iy, int16_t *dst) const {
+    for (const int x : used_cols_) {
+      const int8_t *src = in_n + (size_t(iy) * g_.in_w + x) * g_.in_c;
+      int16_t *d = dst + size_t(x) * c_pad_;
+      for (int c = 0; c < g_.in_c; ++c) {
+        d[c] = int16_t(src[c] - input_zp_);
+      }
+      std::fill(d + g_.in_c, d + c_pad_, int16_t(0));
+    }
+  }
+
+  /**
+   * @brief Keeps the k_h input rows of the current output row widened, in slots tagged with their row, so each
+   * row is widened once per image while it stays in the window and rows the stride skips are never touched.
+   */
+  void RunDepthwise(const int8_t *input, int32_t *output) const {
+    const size_t row_len = size_t(g_.in_w) * c_pad_;
+    thread_local std::vector<int16_t> rows;
+    thread_local std::vector<int> slot_row;
+    thread_local std::vector<int> tap_slot;
+    thread_local std::vector<bool> slot_busy;
+    thread_local std::vector<int32_t> acc;
+    rows.resize(size_t(g_.k_h) * row_len);
+    tap_slot.resize(g_.k_h);
+    acc.resize(c_pad_);
+    for (int n = 0; n < g_.batch; ++n) {
+      const int8_t *in_n = input + size_t(n) * g_.in_h * g_.in_w * g_.in_c;
+      slot_row.assign(g_.k_h, -1);
+      for (int oy = 0; oy < g_.out_h; ++oy) {
+        // Reuse the slots already holding a row of this window, then widen the missing rows into the others
+        slot_busy.assign(g_.k_h, false);
+        for (int ky = 0; ky < g_.k_h; ++ky) {
+          const int iy = g_.SourceY(oy, ky);
+          const auto it = std::find(slot_row.begin(), slot_row.end(), iy);
+          tap_slot[ky] = iy < 0 || it == slot_row.end() ? -1 : int(it - slot_row.begin());
+          if (tap_slot[ky] >= 0) {
+            slot_busy[tap_slot[ky]] = true;
+          }
+        }
+        for (int ky = 0; ky < g_.k_h; ++ky) {
+          const int iy = g_.SourceY(oy, ky);
+          if (iy < 0 || tap_slot[ky] >= 0) {
+            continue;
+          }
+          const int slot = int(std::find(slot_busy.begin(), slot_busy.end(), false) - slot_busy.begin());
+          WidenRow(in_n, iy, rows.data() + slot * row_len);
+          slot_row[slot] = iy;
+          slot_busy[slot] = true;
+          tap_slot[ky] = slot;
+        }
+        for (int ox = 0; ox < g_.out_w; ++ox) {
+          std::fill(acc.begin(), acc.end(), 0);
+          for (int ky = 0; ky < g_.k_h; ++ky) {
+            if (tap_slot[ky] < 0) {
+              continue;
+            }
+            const int16_t *row = rows.data() + tap_slot[ky] * row_len;
+            for (int kx = 0; kx < g_.k_w; ++kx) {
+              const int ix = g_.SourceX(ox, kx);
+              if (ix >= 0) {
+                mac_(row + size_t(ix) * c_pad_, packed_s16_.data() + (size_t(ky) * g_.k_w + kx) * c_pad_, c_pad_,
+                     acc.data());
+              }
+            }
+          }
+          std::copy(acc.begin(), acc.begin() + g_.out_c,
+                    output + ((size_t(n) * g_.out_h + oy) * g_.out_w + ox) * g_.out_c);
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Unit strides read the NHWC input in place as the M x in_c operand. Otherwise only the pixels the stride
+   * visits are copied out first.
+   */
+  void RunPointwise(const int8_t *input, int32_t *output) const {
+    const size_t pixels = size_t(g_.batch) * g_.out_h * g_.out_w;
+    if (g_.strides.h == 1 && g_.strides.w == 1) {
+      gemm_->Run(input, pixels, output);
+      return;
+    }
+    thread_local std::vector<int8_t> visited;
+    visited.resize(pixels * g_.in_c);
+    int8_t *dst = visited.data();
+    for (int n = 0; n < g_.batch; ++n) {
+      const int8_t *in_n = input + size_t(n) * g_.in_h * g_.in_w * g_.in_c;
+      for (int oy = 0; oy < g_.out_h; ++oy) {
+        for (int ox = 0; ox < g_.out_w; ++ox) {
+          const size_t p = size_t(oy) * g_.strides.h * g_.in_w + size_t(ox) * g_.strides.w;
+          dst = std::copy_n(in_n + p * g_.in_c, g_.in_c, dst);
+        }
+      }
+    }
+    gemm_->Run(visited.data(), pixels, output);
+  }
+
+  /**
+   * @brief Accumulators of output channels [o0, o0 + count) for one patch of k_ values zero padded to k_pad_.
+   */
+  void Dot(const int8_t *patch, int o0, int count, int32_t *out) const {
+    dot_(patch, packed_s8_.data() + size_t(o0) * k_pad_, w_sums_.data() + o0, k_pad_, count, out);
+    int32_t row_sum = 0;
+    for (size_t i = 0; i < k_; ++i) {
+      row_sum += patch[i];
+    }
+    for (int j = 0; j < count; ++j) {
+      out[j] += col_term_[o0 + j] - w_zp_[o0 + j] * row_sum;
+    }
+  }
+
+  void Gather(const int8_t *in_n, int oy, int ox, int c0, int8_t *patch) const {
+    const int icg = g_.InChannelsPerGroup();
+    for (int ky = 0; ky < g_.k_h; ++ky) {
+      const int iy = g_.SourceY(oy, ky);
+      for (int kx = 0; kx < g_.k_w; ++kx) {
+        int8_t *dst = patch + (size_t(ky) * g_.k_w + kx) * icg;
+        const int ix = iy < 0 ? -1 : g_.SourceX(ox, kx);
+        if (ix < 0) {
+          // Padding holds the input zero point, which contributes nothing once corrected
+          std::fill(dst, dst + icg, int8_t(input_zp_));
+          continue;
+        }
+        std::copy_n(in_n + (size_t(iy) * g_.in_w + ix) * g_.in_c + c0, icg, dst);
+      }
+    }
+  }
+
+  Conv2dGeometry g_;
+  int32_t input_zp_;
+  ConvAlgo algo_;
+  QDotFn dot_;
+  QMacFn mac_;
+  Isa isa_;
+  size_t k_{0};
+  size_t k_pad_{0};
+  size_t c_pad_{0};
+  // Generic: int8 weight rows with their sums and per channel zero point terms
+  std::vector<int8_t> packed_s8_;
+  std::vector<int32_t> w_sums_;
+  std::vector<int32_t> w_zp_;
+  std::vector<int32_t> col_term_;
+  // Depthwise: zero point corrected int16 taps and the input columns they read
+  std::vector<int16_t> packed_s16_;
+  std::vector<int> used_cols_;
+  // Pointwise: weights prepacked for the GEMM micro-kernels
+  std::shared_ptr<const GemmS8> gemm_;
+};
+
+}  // namespace kernels
+}  // namespace mera
+
+#endif  // MDNA_KERNELS_QCONV2D_H
@@ -0,0 +1,299 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_KERNELS_QDOT_H
+#define MDNA_KERNELS_QDOT_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "cpu_features.h"
+
+/**
+ * @file qdot.h
+ * @brief Multi row int8 dot products and int16 element wise multiply-accumulates, the inner loops of the quantized
+ * host kernels.
+ *
+ * Dot products take the raw int8 operands and return exact int32 sums of their products; the zero points are
+ * applied afterwards by the caller from row and column sums, as in GemmS8. The element wise kernels work on zero
+ * point corrected int16 values instead, as the depthwise convolution has no reduction to fold the corrections
+ * into.
+ */
+namespace mera {
+namespace kernels {
+
+// Reduction lengths passed to a QDotFn must be a multiple of this
+constexpr size_t kQDotBlock = 64;
+
+/**
+ * @brief out[j] = sum_i x[i] * w[j * k + i], for j in [0, n). 'w_sums[j]' is sum_i w[j * k + i], computed when the
+ * weights are packed: kernels built on u8 x s8 instructions feed them x + 128 and subtract 128 * w_sums[j]. 'k' is a
+ * multiple of kQDotBlock.
+ */
+using QDotFn = void (*)(const int8_t *x, const int8_t *w, const int32_t *w_sums, size_t k, size_t n, int32_t *out);
+
+// Lengths passed to a QMacFn must be a multiple of this
+constexpr size_t kQMacBlock = 16;
+
+/**
+ * @brief acc[i] += x[i] * w[i], for i in [0, n). 'n' is a multiple of kQMacBlock.
+ */
+using QMacFn = void (*)(const int16_t *x, const int16_t *w, size_t n, int32_t *acc);
+
+namespace detail {
+
+inline void QDotScalar(const int8_t *x, const int8_t *w, const int32_t * /*w_sums*/, size_t k, size_t n, int32_t *out) {
+  for (size_t j = 0; j < n; ++j) {
+    const int8_t *wj = w + j * k;
+    int32_t acc = 0;
+    for (size_t i = 0; i < k; ++i) {
+      acc += int32_t(x[i]) * wj[i];
+    }
+    out[j] = acc;
+  }
+}
+
+inline void QMacScalar(const int16_t *x, const int16_t *w, size_t n, int32_t *acc) {
+  for (size_t i = 0; i < n; ++i) {
+    acc[i] += int32_t(x[i]) * w[i];
+  }
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+
+// GCC 12 reports the _mm*_undefined_*() placeholders used inside some AVX-512 intrinsics as maybe uninitialized
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+__attribute__((target("avx2"))) inline void QMacAvx2(const int16_t *x, const int16_t *w, size_t n, int32_t *acc) {
+  for (size_t i = 0; i < n; i += 8) {
+    const __m256i xv = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+    const __m256i wv = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w + i)));
+    __m256i *a = reinterpret_cast<__m256i*>(acc + i);
+    _mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a), _mm256_mullo_epi32(xv, wv)));
+  }
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline void QMacAvx512(const int16_t *x, const int16_t *w, size_t n,
+                                                                 int32_t *acc) {
+  for (size_t i = 0; i < n; i += 16) {
+    const __m512i xv = _mm512_cvtepi16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i)));
+    const __m512i wv = _mm512_cvtepi16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i)));
+    _mm512_storeu_si512(acc + i, _mm512_add_epi32(_mm512_loadu_si512(acc + i), _mm512_mullo_epi32(xv, wv)));
+  }
+}
+
+__attribute__((target("avx2"))) inline int32_t HSum256(__m256i v) {
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+  return _mm_cvtsi128_si32(s);
+}
+
+__attribute__((target("avx512f"))) inline int32_t HSum512(__m512i v) {
+  return HSum256(_mm256_add_epi32(_mm512_castsi512_si256(v), _mm512_extracti64x4_epi64(v, 1)));
+}
+
+__attribute__((target("avx2"))) inline __m256i LoadS8AsS16(const int8_t *p) {
+  return _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+// Products of 16 int8 widened to int16, exact; four rows at a time so every load of 'x' feeds four rows
+__attribute__((target("avx2"))) inline void QDotAvx2(const int8_t *x, const int8_t *w, const int32_t * /*w_sums*/,
+                                                     size_t k, size_t n, int32_t *out) {
+  size_t j = 0;
+  for (; j + 4 <= n; j += 4) {
+    const int8_t *w0 = w + j * k;
+    __m256i a0 = _mm256_setzero_si256(), a1 = a0, a2 = a0, a3 = a0;
+    for (size_t i = 0; i < k; i += 16) {
+      const __m256i xv = LoadS8AsS16(x + i);
+      a0 = _mm256_add_epi32(a0, _mm256_madd_epi16(xv, LoadS8AsS16(w0 + i)));
+      a1 = _mm256_add_epi32(a1, _mm256_madd_epi16(xv, LoadS8AsS16(w0 + k + i)));
+      a2 = _mm256_add_epi32(a2, _mm256_madd_epi16(xv, LoadS8AsS16(w0 + 2 * k + i)));
+      a3 = _mm256_add_epi32(a3, _mm256_madd_epi16(xv, LoadS8AsS16(w0 + 3 * k + i)));
+    }
+    out[j] = HSum256(a0);
+    out[j + 1] = HSum256(a1);
+    out[j + 2] = HSum256(a2);
+    out[j + 3] = HSum256(a3);
+  }
+  for (; j < n; ++j) {
+    const int8_t *wj = w + j * k;
+    __m256i a = _mm256_setzero_si256();
+    for (size_t i = 0; i < k; i += 16) {
+      a = _mm256_add_epi32(a, _mm256_madd_epi16(LoadS8AsS16(x + i), LoadS8AsS16(wj + i)));
+    }
+    out[j] = HSum256(a);
+  }
+}
+
+// u8 x s8 quads with vpdpbusd: 'x' is flipped to x + 128 and 128 * w_sums[j] taken back off each result
+__attribute__((target("avx512f,avx512bw,avx512vnni"))) inline void QDotAvx512Vnni(
+    const int8_t *x, const int8_t *w, const int32_t *w_sums, size_t k, size_t n, int32_t *out) {
+  const __m512i flip = _mm512_set1_epi8(int8_t(0x80));
+  size_t j = 0;
+  for (; j + 4 <= n; j += 4) {
+    const int8_t *w0 = w + j * k;
+    __m512i a0 = _mm512_setzero_si512(), a1 = a0, a2 = a0, a3 = a0;
+    for (size_t i = 0; i < k; i += 64) {
+      const __m512i xv = _mm512_xor_si512(_mm512_loadu_si512(x + i), flip);
+      a0 = _mm512_dpbusd_epi32(a0, xv, _mm512_loadu_si512(w0 + i));
+      a1 = _mm512_dpbusd_epi32(a1, xv, _mm512_loadu_si512(w0 + k + i));
+      a2 = _mm512_dpbusd_epi32(a2, xv, _mm512_loadu_si512(w0 + 2 * k + i));
+      a3 = _mm512_dpbusd_epi32(a3, xv, _mm512_loadu_si512(w0 + 3 * k + i));
+    }
+    out[j] = HSum512(a0) - 128 * w_sums[j];
+    out[j + 1] = HSum512(a1) - 128 * w_sums[j + 1];
+    out[j + 2] = HSum512(a2) - 128 * w_sums[j + 2];
+    out[j + 3] = HSum512(a3) - 128 * w_sums[j + 3];
+  }
+  for (; j < n; ++j) {
+    const int8_t *wj = w + j * k;
+    __m512i a = _mm512_setzero_si512();
+    for (size_t i = 0; i < k; i += 64) {
+      a = _mm512_dpbusd_epi32(a, _mm512_xor_si512(_mm512_loadu_si512(x + i), flip), _mm512_loadu_si512(wj + i));
+    }
+    out[j] = HSum512(a) - 128 * w_sums[j];
+  }
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif  // __x86_64__
+
+#if defined(__aarch64__)
+
+// Products widened to int16 by smull, exact, then pairwise accumulated into int32
+inline void QDotNeon(const int8_t *x, const int8_t *w, const int32_t * /*w_sums*/, size_t k, size_t n,
+                     int32_t *out) {
+  for (size_t j = 0; j < n; ++j) {
+    const int8_t *wj = w + j * k;
+    int32x4_t a0 = vdupq_n_s32(0), a1 = a0;
+    for (size_t i = 0; i < k; i += 16) {
+      const int8x16_t xv = vld1q_s8(x + i);
+      const int8x16_t wv = vld1q_s8(wj + i);
+      a0 = vpadalq_s16(a0, vmull_s8(vget_low_s8(xv), vget_low_s8(wv)));
+      a1 = vpadalq_s16(a1, vmull_high_s8(xv, wv));
+    }
+    out[j] = vaddvq_s32(vaddq_s32(a0, a1));
+  }
+}
+
+#if defined(__clang__)
+#define MERA_TARGET_DOTPROD __attribute__((target("dotprod")))
+#else
+#define MERA_TARGET_DOTPROD __attribute__((target("+dotprod")))
+#endif
+
+// sdot: four int8 products summed into each int32 lane, four rows at a time
+MERA_TARGET_DOTPROD inline void QDotNeonDot(const int8_t *x, const int8_t *w, const int32_t * /*w_sums*/, size_t k,
+                                            size_t n, int32_t *out) {
+  size_t j = 0;
+  for (; j + 4 <= n; j += 4) {
+    const int8_t *w0 = w + j * k;
+    int32x4_t a0 = vdupq_n_s32(0), a1 = a0, a2 = a0, a3 = a0;
+    for (size_t i = 0; i < k; i += 16) {
+      const int8x16_t xv = vld1q_s8(x + i);
+      a0 = vdotq_s32(a0, xv, vld1q_s8(w0 + i));
+      a1 = vdotq_s32(a1, xv, vld1q_s8(w0 + k + i));
+      a2 = vdotq_s32(a2, xv, vld1q_s8(w0 + 2 * k + i));
+      a3 = vdotq_s32(a3, xv, vld1q_s8(w0 + 3 * k + i));
+    }
+    out[j] = vaddvq_s32(a0);
+    out[j + 1] = vaddvq_s32(a1);
+    out[j + 2] = vaddvq_s32(a2);
+    out[j + 3] = vaddvq_s32(a3);
+  }
+  for (; j < n; ++j) {
+    const int8_t *wj = w + j * k;
+    int32x4_t a = vdupq_n_s32(0);
+    for (size_t i = 0; i < k; i += 16) {
+      a = vdotq_s32(a, vld1q_s8(x + i), vld1q_s8(wj + i));
+    }
+    out[j] = vaddvq_s32(a);
+  }
+}
+
+#undef MERA_TARGET_DOTPROD
+
+inline void QMacNeon(const int16_t *x, const int16_t *w, size_t n, int32_t *acc) {
+  for (size_t i = 0; i < n; i += 8) {
+    const int16x8_t xv = vld1q_s16(x + i);
+    const int16x8_t wv = vld1q_s16(w + i);
+    vst1q_s32(acc + i, vmlal_s16(vld1q_s32(acc + i), vget_low_s16(xv), vget_low_s16(wv)));
+    vst1q_s32(acc + i + 4, vmlal_high_s16(vld1q_s32(acc + i + 4), xv, wv));
+  }
+}
+
+#endif  // __aarch64__
+
+}  // namespace detail
+
+/**
+ * @brief Returns the dot kernel for 'isa', falling back to the portable one when 'isa' is not available in this
+ * build or on this CPU.
+ */
+inline QDotFn SelectQDot(Isa isa) {
+  if (!CpuFeatures::Host().Supports(isa)) {
+    isa = Isa::SCALAR;
+  }
+  switch (isa) {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    case Isa::AVX512_VNNI: return detail::QDotAvx512Vnni;
+    case Isa::AVX2: return detail::QDotAvx2;
+#endif
+#if defined(__aarch64__)
+    case Isa::NEON_DOTPROD: return detail::QDotNeonDot;
+    case Isa::NEON: return detail::QDotNeon;
+#endif
+    default: return detail::QDotScalar;
+  }
+}
+
+/**
+ * @brief Returns the element wise multiply-accumulate kernel for 'isa', with the same fallback as SelectQDot().
+ */
+inline QMacFn SelectQMac(Isa isa) {
+  if (!CpuFeatures::Host().Supports(isa)) {
+    isa = Isa::SCALAR;
+  }
+  switch (isa) {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    case Isa::AVX512_VNNI: return detail::QMacAvx512;
+    case Isa::AVX2: return detail::QMacAvx2;
+#endif
+#if defined(__aarch64__)
+    case Isa::NEON_DOTPROD:
+    case Isa::NEON: return detail::QMacNeon;
+#endif
+    default: return detail::QMacScalar;
+  }
+}
+
+}  // namespace kernels
+}  // namespace mera
+
+#endif  // MDNA_KERNELS_QDOT_H
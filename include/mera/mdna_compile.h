@@ -16,14 +16,97 @@
 #ifndef MDNA_COMPILE_H
 #define MDNA_COMPILE_H
 
+#include <fstream>
+#include <ostream>
+
+#include "mdna_compile_config.h"
 #include "mdna_ir.h"
+#include "mdna_pass_profile.h"
 
 namespace mera {
+namespace ir {
+class WeightSection;
+}  // namespace ir
+
 namespace compile {
 
 std::vector<uint8_t> Compile(const mera::ir::Module& mod, std::string arch,
                              std::string ccfg);
 
+/**
+ * @brief Compiles 'mod' with a typed configuration, see mdna_compile_config.h.
+ */
+inline std::vector<uint8_t> Compile(const mera::ir::Module& mod, std::string arch, const CompileConfig& cfg) {
+  return Compile(mod, std::move(arch), cfg.ToString());
+}
+
+/**
+ * @brief Everything about a Compile() call besides the module, arch and ccfg. 'num_threads' and 'profiler' only
+ * affect how the module is compiled: the result is byte identical to the one of a serial compilation. 'weights'
+ * and 'out' change what is produced, see below.
+ */
+struct CompileOptions {
+  // Worker threads compiling independent functions of the module, and independent partitions within each
+  // function, concurrently. 0 uses std::thread::hardware_concurrency().
+  unsigned num_threads{1};
+
+  // When set, receives a CompilePassRecord after every internal compiler pass, see mdna_pass_profile.h
+  CompileProfiler *profiler{nullptr};
+
+  // Section holding the constants the module externalized (see mdna_ir_weights.h). Payloads are read in place
+  // instead of being copied into the module first, and stay there: the result references them and must be run
+  // with the execute::CreateExecutor() overload taking the same weight section.
+  const mera::ir::WeightSection *weights{nullptr};
+
+  // When set, the compiled module is streamed into it as it is produced instead of being returned, so it is
+  // never held in memory as a whole
+  std::ostream *out{nullptr};
+};
+
+/**
+ * @brief Compiles 'mod' as set by 'opts'. Returns the compiled module, or nothing when it was written to 'opts.out'.
+ */
+std::vector<uint8_t> Compile(const mera::ir::Module& mod, std::string arch,
+                             std::string ccfg, const CompileOptions& opts);
+
+/**
+ * @brief Compiles a module whose constants were externalized into 'weights' (see mdna_ir_weights.h). Payloads are
+ * read in place from the weight section instead of being copied into the module first, and stay there: run the
+ * result with the execute::CreateExecutor() overload taking the same weight section.
+ */
+inline std::vector<uint8_t> Compile(const mera::ir::Module& mod, std::string arch, std::string ccfg,
+                                    const mera::ir::WeightSection& weights) {
+  CompileOptions opts;
+  opts.weights = &weights;
+  return Compile(mod, std::move(arch), std::move(ccfg), opts);
+}
+
+/**
+ * @brief Compiles 'mod' and streams the serialized result into 'out' as it is produced, without building the
+ * whole module in memory first. The bytes written are the same as the ones returned by Compile().
+ */
+inline void Compile(const mera::ir::Module& mod, std::string arch, std::string ccfg, std::ostream& out) {
+  CompileOptions opts;
+  opts.out = &out;
+  Compile(mod, std::move(arch), std::move(ccfg), opts);
+}
+
+/**
+ * @brief Compiles 'mod' straight into the file at 'path'. 'opts.out' is ignored.
+ */
+inline void CompileToFile(const mera::ir::Module& mod, std::string arch, std::string ccfg, const std::string& path,
+                          CompileOptions opts = {}) {
+  std::ofstream os(path, std::ios::binary | std::ios::trunc);
+  if (!os) {
+    throw std::runtime_error("Could not open " + path + " for writing");
+  }
+  opts.out = &os;
+  Compile(mod, std::move(arch), std::move(ccfg), opts);
+  if (!os.flush()) {
+    throw std::runtime_error("Failed writing compiled module to " + path);
+  }
+}
+
 }  // namespace compile
 }  // namespace mera
 
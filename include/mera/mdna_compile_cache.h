@@ -0,0 +1,263 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_COMPILE_CACHE_H
+#define MDNA_COMPILE_CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "nop/serializer.h"
+#include "nop/utility/stream_writer.h"
+#include "mdna_compile.h"
+#include "mdna_ir.h"
+#include "mdna_ir_weights.h"
+#include "mdna_version.h"
+
+/**
+ * @file mdna_compile_cache.h
+ * @brief On-disk, content addressed cache of compile::Compile results.
+ */
+namespace mera {
+namespace compile {
+
+struct CompileCacheStats {
+  uint64_t hits{0};
+  uint64_t misses{0};
+  uint64_t evictions{0};
+  uint64_t bytes_stored{0};
+};
+
+namespace detail {
+
+/**
+ * @brief Feeds the payload of every constant to 'update', reading externalized ones from 'weights'.
+ */
+template <class Update>
+struct ConstantPayloadHasher {
+  const ir::WeightSection *weights;
+  Update &update;
+
+  void operator()(const ir::ExternalFloatVecConstant &n) { Payload<float>(n.payload); }
+  void operator()(const ir::ExternalInt32VecConstant &n) { Payload<int32_t>(n.payload); }
+  void operator()(const ir::ExternalInt8VecConstant &n) { Payload<int8_t>(n.payload); }
+  template <class T>
+  void operator()(const T &n) {}
+
+  template <class T>
+  void Payload(const ir::WeightRef &ref) {
+    if (weights == nullptr) {
+      throw std::invalid_argument("Module has externalized weights, its WeightSection is needed to hash it");
+    }
+    update(weights->Get<T>(ref), size_t(ref.count) * sizeof(T));
+  }
+};
+
+}  // namespace detail
+
+/**
+ * @brief Structural hash of 'mod'. Covers every operator with its attributes, constants and quantization info, and
+ * the tensor names, as compiled modules look buffers up by name. Constants externalized into a weight section are
+ * hashed by their payload in 'weights', never only by their WeightRef, so modules that differ only in their
+ * weights get different hashes; it is an error to leave 'weights' null for such a module. Operators are
+ * serialized one at a time, so no full copy of the module is made.
+ */
+inline std::string ModuleHash(const ir::Module &mod, const ir::WeightSection *weights = nullptr) {
+  uint64_t h1 = 14695981039346656037ull;
+  uint64_t h2 = 0x84222325cbf29ce4ull;
+  auto update = [&](const void *data, size_t size) {
+    h1 = ir::HashBytes(data, size, h1);
+    h2 = ir::HashBytes(data, size, h2 ^ 0x9e3779b97f4a7c15ull);
+  };
+  auto update_value = [&](const auto &value) {
+    nop::Serializer<nop::StreamWriter<std::stringstream>> serializer;
+    auto status = serializer.Write(value);
+    if (!status) {
+      throw std::runtime_error("Failed to serialize module for hashing: " + status.GetErrorMessage());
+    }
+    const std::string bytes = serializer.writer().stream().str();
+    update(bytes.data(), bytes.size());
+  };
+  detail::ConstantPayloadHasher<decltype(update)> payload{weights, update};
+  for (const auto &[name, graph] : mod.functions) {
+    update(name.data(), name.size() + 1);
+    for (const auto &op : graph.operators) {
+      update_value(op);
+      op.Visit(payload);
+    }
+    update_value(graph.qtz_info);
+    update_value(graph.symbols);
+  }
+  char buf[33];
+  std::snprintf(buf, sizeof(buf), "%016llx%016llx", (unsigned long long)h1, (unsigned long long)h2);
+  return buf;
+}
+
+/**
+ * @brief Cache of compiled modules stored as one file per entry in 'directory'. Entries are keyed by the
+ * structural hash of the module, the arch and ccfg strings and the mera-dna version. Entries are written to a
+ * temporary file and renamed into place, so concurrent processes never observe partial entries. When the total
+ * size exceeds 'max_bytes' the least recently used entries are evicted.
+ */
+class CompileCache {
+ public:
+  CompileCache(const std::string &directory, uint64_t max_bytes): dir_(directory), max_bytes_(max_bytes) {
+    std::filesystem::create_directories(dir_);
+  }
+
+  /**
+   * @brief Returns the cache key for compiling 'mod' with 'arch' and 'ccfg'. 'weights' is the section holding the
+   * externalized constants of 'mod', if any.
+   */
+  static std::string Key(const ir::Module &mod, const std::string &arch, const std::string &ccfg,
+                         const ir::WeightSection *weights = nullptr) {
+    const std::string extra = arch + '\0' + ccfg + '\0' + GetMeradnaVersionStr();
+    const uint64_t h = ir::HashBytes(extra.data(), extra.size());
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)h);
+    return ModuleHash(mod, weights) + buf;
+  }
+
+  /**
+   * @brief Returns the cached compilation of 'mod' or compiles and stores it. 'opts.weights' is part of the key,
+   * the other options do not change the result. 'opts.out' must be null, as the result is returned.
+   */
+  std::vector<uint8_t> Compile(const ir::Module &mod, const std::string &arch, const std::string &ccfg,
+                               const CompileOptions &opts = {}) {
+    if (opts.out != nullptr) {
+      throw std::invalid_argument("CompileCache returns the compiled module, CompileOptions::out must be null");
+    }
+    const std::string key = Key(mod, arch, ccfg, opts.weights);
+    if (auto hit = Lookup(key)) {
+      return std::move(*hit);
+    }
+    auto data = compile::Compile(mod, arch, ccfg, opts);
+    Store(key, data);
+    return data;
+  }
+
+  /**
+   * @brief Same as above for a module whose constants were externalized into 'weights'.
+   */
+  std::vector<uint8_t> Compile(const ir::Module &mod, const std::string &arch, const std::string &ccfg,
+                               const ir::WeightSection &weights) {
+    CompileOptions opts;
+    opts.weights = &weights;
+    return Compile(mod, arch, ccfg, opts);
+  }
+
+  std::optional<std::vector<uint8_t>> Lookup(const std::string &key) {
+    const auto path = EntryPath(key);
+    std::ifstream is(path, std::ios::binary);
+    if (!is) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++stats_.misses;
+      return std::nullopt;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    std::error_code ec;
+    // Recency for LRU eviction is the modification time of the entry
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.hits;
+    return data;
+  }
+
+  void Store(const std::string &key, const std::vector<uint8_t> &data) {
+    static std::atomic<uint64_t> counter{0};
+    const auto path = EntryPath(key);
+    const auto tmp = dir_ / (key + ".tmp." + std::to_string(::getpid()) + "." + std::to_string(counter++));
+    {
+      std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+      os.write(reinterpret_cast<const char*>(data.data()), data.size());
+      if (!os.flush()) {
+        std::error_code ec;
+        std::filesystem::remove(tmp, ec);
+        throw std::runtime_error("Failed writing compile cache entry " + tmp.string());
+      }
+    }
+    std::filesystem::rename(tmp, path);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.bytes_stored += data.size();
+    }
+    Evict();
+  }
+
+  CompileCacheStats Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+ private:
+  static constexpr const char *kEntrySuffix = ".mdnac";
+
+  std::filesystem::path EntryPath(const std::string &key) const { return dir_ / (key + kEntrySuffix); }
+
+  void Evict() {
+    struct Entry {
+      std::filesystem::path path;
+      std::filesystem::file_time_type time;
+      uint64_t size;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code ec;
+    for (const auto &e : std::filesystem::directory_iterator(dir_, ec)) {
+      if (e.path().extension() != kEntrySuffix) {
+        continue;
+      }
+      const uint64_t size = e.file_size(ec);
+      entries.push_back({e.path(), e.last_write_time(ec), size});
+      total += size;
+    }
+    if (total <= max_bytes_) {
+      return;
+    }
+    std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) { return a.time < b.time; });
+    uint64_t evicted = 0;
+    for (const auto &e : entries) {
+      if (total <= max_bytes_) {
+        break;
+      }
+      if (std::filesystem::remove(e.path, ec)) {
+        total -= e.size;
+        ++evicted;
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.evictions += evicted;
+  }
+
+  const std::filesystem::path dir_;
+  const uint64_t max_bytes_;
+  mutable std::mutex mutex_;
+  CompileCacheStats stats_;
+};
+
+}  // namespace compile
+}  // namespace mera
+
+#endif  // MDNA_COMPILE_CACHE_H
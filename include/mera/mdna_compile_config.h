@@ -0,0 +1,275 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_COMPILE_CONFIG_H
+#define MDNA_COMPILE_CONFIG_H
+
+#include <cstdint>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @file mdna_compile_config.h
+ * @brief Typed representation of the 'ccfg' string taken by compile::Compile.
+ *
+ * compile::Compile has so far taken 'ccfg' as an opaque string. This header defines its grammar, which the
+ * compiler library implements: a list of 'key=value' entries separated by ';', where an empty string selects all
+ * the defaults. The typed keys are those of the CompileConfig fields below, and per pass flags use the key
+ * 'pass.<name>'. Entries with any other key are kept verbatim in CompileConfig::extra and written back by
+ * ToString(), so configurations using keys unknown to this header reach the compiler unchanged.
+ */
+namespace mera {
+namespace compile {
+
+/**
+ * @brief Error raised for an invalid compile configuration entry. key() names the offending key.
+ */
+class CompileConfigError : public std::runtime_error {
+ public:
+  CompileConfigError(const std::string &key, const std::string &msg):
+    std::runtime_error("Invalid compile config key '" + key + "': " + msg), key_(key) {}
+
+  const std::string &key() const { return key_; }
+
+ private:
+  std::string key_;
+};
+
+struct CompileConfig {
+  enum class Scheduler { AUTO, GREEDY, ANNEALING };
+
+  // Optimization level, from 0 (fastest compile) to 3 (best code)
+  int opt_level{2};
+
+  // Tile sizes used when splitting activations. 0 lets the compiler choose
+  int tile_h{0};
+  int tile_w{0};
+  int tile_c{0};
+
+  // Instruction scheduling strategy, and its iteration budget for ANNEALING. 0 uses the default budget
+  Scheduler scheduler{Scheduler::AUTO};
+  int scheduler_iterations{0};
+
+  // Enable flags of individual compiler passes, by pass name. Passes not listed keep their default
+  std::map<std::string, bool> passes;
+
+  // Resource limits of the compilation. 0 means unlimited
+  uint64_t max_memory_bytes{0};
+  int max_compile_seconds{0};
+
+  // Entries without a typed field, as 'key', 'value' pairs in their original order. Passed to the compiler as is
+  std::vector<std::pair<std::string, std::string>> extra;
+
+  /**
+   * @brief Throws CompileConfigError for the first value out of range.
+   */
+  void Validate() const {
+    if (opt_level < 0 || opt_level > 3) {
+      throw CompileConfigError("opt_level", "must be in [0, 3], got " + std::to_string(opt_level));
+    }
+    const std::pair<const char*, int> non_negative[] = {
+      {"tile_h", tile_h}, {"tile_w", tile_w}, {"tile_c", tile_c},
+      {"scheduler_iterations", scheduler_iterations}, {"max_compile_seconds", max_compile_seconds}};
+    for (const auto &[key, value] : non_negative) {
+      if (value < 0) {
+        throw CompileConfigError(key, "must not be negative, got " + std::to_string(value));
+      }
+    }
+    if (scheduler_iterations > 0 && scheduler != Scheduler::ANNEALING) {
+      throw CompileConfigError("scheduler_iterations", "only applies to scheduler=annealing");
+    }
+    for (const auto &[name, enabled] : passes) {
+      if (name.empty() || name.find_first_of("=; ") != std::string::npos) {
+        throw CompileConfigError("pass." + name, "invalid pass name");
+      }
+    }
+    for (const auto &[key, value] : extra) {
+      if (key.empty() || key.find_first_of("=;") != std::string::npos || value.find(';') != std::string::npos) {
+        throw CompileConfigError(key, "entry cannot be written as 'key=value'");
+      }
+      // ToString() would write the key twice, once from its typed field
+      if (IsTypedKey(key)) {
+        throw CompileConfigError(key, "has a typed field, it cannot be an extra entry");
+      }
+    }
+  }
+
+  /**
+   * @brief Returns the canonical string form: keys in a fixed order, defaults omitted. Equal configs always give
+   * the same string.
+   */
+  std::string ToString() const {
+    Validate();
+    const CompileConfig def;
+    std::ostringstream ss;
+    auto put = [&](const std::string &key, const auto &value) { ss << key << '=' << value << ';'; };
+    if (opt_level != def.opt_level) { put("opt_level", opt_level); }
+    if (tile_h != def.tile_h) { put("tile_h", tile_h); }
+    if (tile_w != def.tile_w) { put("tile_w", tile_w); }
+    if (tile_c != def.tile_c) { put("tile_c", tile_c); }
+    if (scheduler != def.scheduler) { put("scheduler", SchedulerName(scheduler)); }
+    if (scheduler_iterations != def.scheduler_iterations) { put("scheduler_iterations", scheduler_iterations); }
+    if (max_memory_bytes != def.max_memory_bytes) { put("max_memory_bytes", max_memory_bytes); }
+    if (max_compile_seconds != def.max_compile_seconds) { put("max_compile_seconds", max_compile_seconds); }
+    for (const auto &[name, enabled] : passes) {
+      put("pass." + name, enabled ? 1 : 0);
+    }
+    for (const auto &[key, value] : extra) {
+      put(key, value);
+    }
+    std::string r = ss.str();
+    if (!r.empty()) {
+      r.pop_back();
+    }
+    return r;
+  }
+
+  /**
+   * @brief Parses the string form. Throws CompileConfigError for malformed entries and for malformed or out of
+   * range values of the typed keys. Other keys go to 'extra'.
+   */
+  static CompileConfig Parse(const std::string &ccfg) {
+    CompileConfig cfg;
+    std::istringstream ss(ccfg);
+    std::string entry;
+    while (std::getline(ss, entry, ';')) {
+      entry = Trim(entry);
+      if (entry.empty()) {
+        continue;
+      }
+      const size_t eq = entry.find('=');
+      if (eq == std::string::npos) {
+        throw CompileConfigError(entry, "expected 'key=value'");
+      }
+      const std::string key = Trim(entry.substr(0, eq));
+      const std::string value = Trim(entry.substr(eq + 1));
+      if (key == "opt_level") {
+        cfg.opt_level = ParseInt(key, value);
+      } else if (key == "tile_h") {
+        cfg.tile_h = ParseInt(key, value);
+      } else if (key == "tile_w") {
+        cfg.tile_w = ParseInt(key, value);
+      } else if (key == "tile_c") {
+        cfg.tile_c = ParseInt(key, value);
+      } else if (key == "scheduler") {
+        cfg.scheduler = ParseScheduler(key, value);
+      } else if (key == "scheduler_iterations") {
+        cfg.scheduler_iterations = ParseInt(key, value);
+      } else if (key == "max_memory_bytes") {
+        cfg.max_memory_bytes = ParseUInt64(key, value);
+      } else if (key == "max_compile_seconds") {
+        cfg.max_compile_seconds = ParseInt(key, value);
+      } else if (key.rfind("pass.", 0) == 0) {
+        const int v = ParseInt(key, value);
+        if (v != 0 && v != 1) {
+          throw CompileConfigError(key, "expected 0 or 1, got '" + value + "'");
+        }
+        cfg.passes[key.substr(5)] = v == 1;
+      } else {
+        cfg.extra.emplace_back(key, value);
+      }
+    }
+    cfg.Validate();
+    return cfg;
+  }
+
+ private:
+  static bool IsTypedKey(const std::string &key) {
+    static const char *keys[] = {"opt_level", "tile_h", "tile_w", "tile_c", "scheduler", "scheduler_iterations",
+                                 "max_memory_bytes", "max_compile_seconds"};
+    for (const char *k : keys) {
+      if (key == k) {
+        return true;
+      }
+    }
+    return key.rfind("pass.", 0) == 0;
+  }
+
+  static const char *SchedulerName(Scheduler s) {
+    static const char *names[] = {"auto", "greedy", "annealing"};
+    return names[int(s)];
+  }
+
+  static Scheduler ParseScheduler(const std::string &key, const std::string &value) {
+    for (const Scheduler s : {Scheduler::AUTO, Scheduler::GREEDY, Scheduler::ANNEALING}) {
+      if (value == SchedulerName(s)) {
+        return s;
+      }
+    }
+    throw CompileConfigError(key, "unknown scheduler '" + value + "'");
+  }
+
+  static long long ParseInt(const std::string &key, const std::string &value) {
+    size_t end = 0;
+    long long v = 0;
+    try {
+      v = std::stoll(value, &end);
+    } catch (const std::exception &) {
+      end = 0;
+    }
+    if (value.empty() || end != value.size()) {
+      throw CompileConfigError(key, "expected an integer, got '" + value + "'");
+    }
+    if (v < INT32_MIN || v > INT32_MAX) {
+      throw CompileConfigError(key, "value " + value + " out of range");
+    }
+    return v;
+  }
+
+  static uint64_t ParseUInt64(const std::string &key, const std::string &value) {
+    size_t end = 0;
+    uint64_t v = 0;
+    try {
+      // stoull accepts a sign and wraps negative values around
+      if (!value.empty() && (value[0] == '-' || value[0] == '+')) {
+        throw std::invalid_argument(value);
+      }
+      v = std::stoull(value, &end);
+    } catch (const std::out_of_range &) {
+      throw CompileConfigError(key, "value " + value + " out of range");
+    } catch (const std::exception &) {
+      end = 0;
+    }
+    if (value.empty() || end != value.size()) {
+      throw CompileConfigError(key, "expected an unsigned integer, got '" + value + "'");
+    }
+    return v;
+  }
+
+  static std::string Trim(const std::string &s) {
+    const size_t b = s.find_first_not_of(" \t\n");
+    const size_t e = s.find_last_not_of(" \t\n");
+    return b == std::string::npos ? std::string() : s.substr(b, e - b + 1);
+  }
+};
+
+inline bool operator==(const CompileConfig &lhs, const CompileConfig &rhs) {
+  return lhs.opt_level == rhs.opt_level && lhs.tile_h == rhs.tile_h && lhs.tile_w == rhs.tile_w
+    && lhs.tile_c == rhs.tile_c && lhs.scheduler == rhs.scheduler
+    && lhs.scheduler_iterations == rhs.scheduler_iterations && lhs.passes == rhs.passes
+    && lhs.max_memory_bytes == rhs.max_memory_bytes
+    && lhs.max_compile_seconds == rhs.max_compile_seconds && lhs.extra == rhs.extra;
+}
+
+inline bool operator!=(const CompileConfig &lhs, const CompileConfig &rhs) { return !(lhs == rhs); }
+
+}  // namespace compile
+}  // namespace mera
+
+#endif  // MDNA_COMPILE_CONFIG_H
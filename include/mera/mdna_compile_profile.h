@@ -0,0 +1,119 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_COMPILE_PROFILE_H
+#define MDNA_COMPILE_PROFILE_H
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <stdexcept>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mdna_pass_profile.h"
+
+/**
+ * @file mdna_compile_profile.h
+ * @brief Collection and Chrome trace export of the per pass measurements of the compilation.
+ */
+namespace mera {
+namespace compile {
+
+// The pass measurement types live in mdna_pass_profile.h, shared with the IR passes
+using mera::CompilePassRecord;
+using mera::CompileProfiler;
+using mera::ScopedPassTimer;
+
+/**
+ * @brief Profiler collecting all records into a report.
+ */
+class CompileProfile : public CompileProfiler {
+ public:
+  void OnPass(const CompilePassRecord &record) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    records_.push_back(record);
+  }
+
+  std::vector<CompilePassRecord> Records() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return records_;
+  }
+
+  /**
+   * @brief Returns the report in Chrome trace event format, viewable in chrome://tracing or Perfetto. Each
+   * function gets its own track.
+   */
+  std::string ToChromeTrace() const {
+    std::ostringstream ss;
+    // Timestamps reach 1e6 us after a second, past the 6 significant digits of the default format
+    ss << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    bool first = true;
+    std::vector<std::string> tracks;
+    for (const auto &r : Records()) {
+      size_t tid = 0;
+      while (tid < tracks.size() && tracks[tid] != r.function) { ++tid; }
+      if (tid == tracks.size()) { tracks.push_back(r.function); }
+      ss << (first ? "" : ",") << "{\"name\":\"" << Escape(r.name) << "\",\"cat\":\"compile\",\"ph\":\"X\""
+         << ",\"pid\":0,\"tid\":" << tid << ",\"ts\":" << r.start_us << ",\"dur\":" << r.wall_us
+         << ",\"args\":{\"function\":\"" << Escape(r.function) << "\",\"cpu_us\":" << r.cpu_us
+         << ",\"peak_alloc_bytes\":" << r.peak_alloc_bytes << ",\"ops_before\":" << r.ops_before
+         << ",\"ops_after\":" << r.ops_after << "}}";
+      first = false;
+    }
+    ss << "]}";
+    return ss.str();
+  }
+
+  void WriteChromeTrace(const std::string &path) const {
+    std::ofstream os(path);
+    os << ToChromeTrace();
+    if (!os) {
+      throw std::runtime_error("Failed writing compile trace to " + path);
+    }
+  }
+
+ private:
+  static std::string Escape(const std::string &s) {
+    std::string r;
+    for (const char c : s) {
+      if (c == '"' || c == '\\') {
+        r += '\\';
+        r += c;
+      } else if (c == '\n') {
+        r += "\\n";
+      } else if (c == '\t') {
+        r += "\\t";
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        char buf[7];
+        std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
+        r += buf;
+      } else {
+        r += c;
+      }
+    }
+    return r;
+  }
+
+  mutable std::mutex mutex_;
+  std::vector<CompilePassRecord> records_;
+};
+
+}  // namespace compile
+}  // namespace mera
+
+#endif  // MDNA_COMPILE_PROFILE_H
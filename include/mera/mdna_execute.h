@@ -16,14 +16,49 @@
 #ifndef MDNA_EXECUTE_H
 #define MDNA_EXECUTE_H
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <istream>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
 namespace mera {
+namespace ir {
+class WeightSection;
+}  // namespace ir
+
 namespace execute {
 
+/**
+ * @brief Amount of detail collected by Executor::Run(). BASIC only fills the per-function numbers and is cheap
+ * enough to stay on in production. DETAILED adds the per-operator breakdown.
+ */
+enum class MetricsLevel {
+  BASIC, DETAILED
+};
+
+/**
+ * @brief Measurements of one compiled kernel during a run.
+ */
+struct OperatorMetrics {
+  // Indices into ir::Graph::operators of the function. Several when the compiler fused operators into one kernel
+  std::vector<int32_t> ir_operators;
+  // Name of the output tensor of the last operator in 'ir_operators'
+  std::string name;
+  std::chrono::nanoseconds wall_time{0};
+  uint64_t bytes_moved{0};
+  uint64_t macs{0};
+};
+
 struct ExecutorMetrics {
   enum class MetricsType {
     RUNTIME, POWER
@@ -34,16 +69,297 @@ struct ExecutorMetrics {
 
   // Method for serializing up to TVM
   const std::string AsString(MetricsType type) const;
+
+  // Function that was run
+  std::string function;
+  // End to end time of Run(), and the part of it spent executing on the device
+  std::chrono::nanoseconds total_time{0};
+  std::chrono::nanoseconds device_time{0};
+  // Numeric backend counters by name, e.g. "power_w" or "dma_bytes"
+  std::map<std::string, double> counters;
+  // Per kernel breakdown in execution order, only filled with MetricsLevel::DETAILED
+  std::vector<OperatorMetrics> operators;
+
+  /**
+   * @brief Returns the kernel that computed IR operator 'ir_operator', or nullptr if not measured.
+   */
+  const OperatorMetrics *FindOperator(int32_t ir_operator) const {
+    for (const auto &op : operators) {
+      if (std::find(op.ir_operators.begin(), op.ir_operators.end(), ir_operator) != op.ir_operators.end()) {
+        return &op;
+      }
+    }
+    return nullptr;
+  }
+
  protected:
   std::map<const std::string, std::string> metrics_;
   std::map<std::string, MetricsType> metric_types_;
 };
 
+/**
+ * @brief Function of a module resolved once with Executor::ResolveFunction().
+ */
+struct FunctionHandle {
+  int32_t id{-1};
+};
+
+/**
+ * @brief Set of argument buffers registered with Executor::RegisterBuffers(). Each slot is one complete argument
+ * list of the function, so a ring of N slots lets N requests be prepared while others run.
+ */
+struct IoBinding {
+  int32_t id{-1};
+  size_t num_slots{0};
+};
+
+/**
+ * @brief Decoding state of one sequence, created with Executor::CreateSession(): the key/value cache of every
+ * causal Attention of the function, kept across runs.
+ */
+struct SessionHandle {
+  int32_t id{-1};
+};
+
+/**
+ * @brief Runs the functions of a compiled module.
+ *
+ * Thread safety: Run() may be called concurrently from any number of threads on the same Executor, as long as
+ * every call uses its own argument buffers. Concurrent requests are executed in an unspecified order and each one
+ * sees only its own inputs. See AsyncExecutor in mdna_execute_async.h to queue runs without blocking. Buffer
+ * registration is thread safe too, but a binding must not be unregistered while one of its slots is running.
+ * Sessions are created, reset and destroyed thread safely as well; distinct sessions may run concurrently, but each
+ * session runs one request at a time and must not be reset or destroyed while it runs.
+ */
 class Executor {
  public:
   virtual ~Executor() {}
+
   virtual ExecutorMetrics Run(const std::string& function,
                               std::vector<void*>& args) const = 0;
+
+  /**
+   * @brief Selects the detail of the metrics returned by later runs. Defaults to MetricsLevel::BASIC.
+   */
+  void SetMetricsLevel(MetricsLevel level) { metrics_level_ = level; }
+  MetricsLevel GetMetricsLevel() const { return metrics_level_; }
+
+  // Alignment in bytes required for registered buffers
+  static constexpr size_t kIoAlignment = 64;
+
+  /**
+   * @brief Resolves 'function' once, so later calls do not look it up by name.
+   */
+  FunctionHandle ResolveFunction(const std::string& function) const {
+    std::unique_lock<std::shared_mutex> lock(bind_mutex_);
+    for (size_t i = 0; i < functions_.size(); ++i) {
+      if (functions_[i] == function) {
+        return FunctionHandle{int32_t(i)};
+      }
+    }
+    CheckFunction(function);
+    functions_.push_back(function);
+    return FunctionHandle{int32_t(functions_.size() - 1)};
+  }
+
+  /**
+   * @brief Registers the argument buffers of 'function', one argument list per slot. Every buffer must be aligned
+   * to kIoAlignment and stay valid until UnregisterBuffers(). Arguments are validated here once instead of on
+   * every Run(), and backends may map or pin the buffers so that runs need no staging copies.
+   */
+  IoBinding RegisterBuffers(FunctionHandle function, std::vector<std::vector<void*>> slots) const {
+    if (slots.empty()) {
+      throw std::invalid_argument("At least one buffer slot is needed");
+    }
+    for (const auto &args : slots) {
+      for (const void *p : args) {
+        if (p == nullptr) {
+          throw std::invalid_argument("Registered buffers must not be null");
+        }
+        if (reinterpret_cast<uintptr_t>(p) % kIoAlignment != 0) {
+          throw std::invalid_argument("Registered buffers must be aligned to " + std::to_string(kIoAlignment) +
+                                      " bytes");
+        }
+      }
+    }
+    std::unique_lock<std::shared_mutex> lock(bind_mutex_);
+    const std::string &name = FunctionName(function);
+    CheckBinding(name, slots);
+    size_t id = 0;
+    while (id < bindings_.size() && bindings_[id]) { ++id; }
+    if (id == bindings_.size()) {
+      bindings_.emplace_back();
+    }
+    const IoBinding binding{int32_t(id), slots.size()};
+    bindings_[id] = Binding{function.id, std::move(slots)};
+    return binding;
+  }
+
+  void UnregisterBuffers(IoBinding binding) const {
+    std::unique_lock<std::shared_mutex> lock(bind_mutex_);
+    FindBinding(binding);
+    ReleaseBinding(binding);
+    bindings_[binding.id].reset();
+  }
+
+  /**
+   * @brief Runs the function of 'binding' on the buffers of 'slot'. Named apart from Run() so that executors
+   * overriding Run() do not hide it.
+   */
+  ExecutorMetrics RunBound(const IoBinding& binding, size_t slot) const {
+    std::string function;
+    std::vector<void*> args;
+    {
+      // Only held for the lookup, so registration never waits for a run to finish
+      std::shared_lock<std::shared_mutex> lock(bind_mutex_);
+      const Binding &b = FindBinding(binding);
+      if (slot >= b.slots.size()) {
+        throw std::out_of_range("Slot " + std::to_string(slot) + " out of range, binding has " +
+                                std::to_string(b.slots.size()));
+      }
+      function = functions_[b.function];
+      args = b.slots[slot];
+    }
+    return RunSlot(function, binding, slot, args);
+  }
+
+  /**
+   * @brief Starts decoding a sequence with 'function', which may then run through RunSession() for up to
+   * 'max_length' tokens in total. Every causal Attention of the function gets its own key/value cache: a run
+   * appends the keys and values of its input tokens to it and attends their queries over all tokens so far, so a
+   * decoding step only computes the rows of its new tokens. Create one session per sequence decoded concurrently.
+   */
+  SessionHandle CreateSession(FunctionHandle function, size_t max_length) const {
+    if (max_length == 0) {
+      throw std::invalid_argument("A session needs room for at least one token");
+    }
+    std::unique_lock<std::shared_mutex> lock(bind_mutex_);
+    CheckSession(FunctionName(function), max_length);
+    size_t id = 0;
+    while (id < sessions_.size() && sessions_[id]) { ++id; }
+    if (id == sessions_.size()) {
+      sessions_.emplace_back();
+    }
+    sessions_[id] = Session{function.id, max_length};
+    return SessionHandle{int32_t(id)};
+  }
+
+  /**
+   * @brief Empties the caches of 'session' so it starts a new sequence, keeping their memory.
+   */
+  void ResetSession(SessionHandle session) const {
+    std::shared_lock<std::shared_mutex> lock(bind_mutex_);
+    FindSession(session);
+    ResetSessionState(session);
+  }
+
+  void DestroySession(SessionHandle session) const {
+    std::unique_lock<std::shared_mutex> lock(bind_mutex_);
+    FindSession(session);
+    ReleaseSession(session);
+    sessions_[session.id].reset();
+  }
+
+  /**
+   * @brief Runs the function of 'session' on the next tokens of its sequence. 'args' are those of Run(), with
+   * the token dimension of the inputs holding only the new tokens. Throws when the session would exceed its
+   * max_length.
+   */
+  ExecutorMetrics RunSession(SessionHandle session, std::vector<void*> args) const {
+    std::string function;
+    {
+      // Only held for the lookup, as in RunBound()
+      std::shared_lock<std::shared_mutex> lock(bind_mutex_);
+      function = functions_[FindSession(session).function];
+    }
+    return RunInSession(function, session, args);
+  }
+
+ protected:
+  /**
+   * @brief Throws std::invalid_argument when the module has no function 'function'. The default accepts any name
+   * and leaves the check to Run().
+   */
+  virtual void CheckFunction(const std::string& function) const {}
+
+  /**
+   * @brief Validates and prepares the slots of a new binding, e.g. by mapping the buffers on the device.
+   */
+  virtual void CheckBinding(const std::string& function, const std::vector<std::vector<void*>>& slots) const {}
+
+  /**
+   * @brief Releases whatever CheckBinding() set up for 'binding'.
+   */
+  virtual void ReleaseBinding(const IoBinding& binding) const {}
+
+  /**
+   * @brief Runs one slot of an already validated binding. The default forwards to Run().
+   */
+  virtual ExecutorMetrics RunSlot(const std::string& function, const IoBinding& binding, size_t slot,
+                                  std::vector<void*>& args) const {
+    return Run(function, args);
+  }
+
+  /**
+   * @brief Prepares the caches of a new session of 'function'. The default throws, for executors that cannot
+   * decode incrementally.
+   */
+  virtual void CheckSession(const std::string& function, size_t max_length) const {
+    throw std::logic_error("This executor does not support decoding sessions");
+  }
+
+  virtual void ResetSessionState(const SessionHandle& session) const {}
+
+  /**
+   * @brief Releases whatever CheckSession() set up for 'session'.
+   */
+  virtual void ReleaseSession(const SessionHandle& session) const {}
+
+  /**
+   * @brief Runs one decoding step of a session created by CheckSession().
+   */
+  virtual ExecutorMetrics RunInSession(const std::string& function, const SessionHandle& session,
+                                       std::vector<void*>& args) const {
+    throw std::logic_error("This executor does not support decoding sessions");
+  }
+
+ private:
+  struct Binding {
+    int32_t function;
+    std::vector<std::vector<void*>> slots;
+  };
+
+  struct Session {
+    int32_t function;
+    size_t max_length;
+  };
+
+  const std::string &FunctionName(FunctionHandle function) const {
+    if (function.id < 0 || size_t(function.id) >= functions_.size()) {
+      throw std::invalid_argument("Invalid function handle");
+    }
+    return functions_[function.id];
+  }
+
+  Binding &FindBinding(const IoBinding &binding) const {
+    if (binding.id < 0 || size_t(binding.id) >= bindings_.size() || !bindings_[binding.id]) {
+      throw std::invalid_argument("Invalid or unregistered IoBinding");
+    }
+    return *bindings_[binding.id];
+  }
+
+  const Session &FindSession(const SessionHandle &session) const {
+    if (session.id < 0 || size_t(session.id) >= sessions_.size() || !sessions_[session.id]) {
+      throw std::invalid_argument("Invalid or destroyed SessionHandle");
+    }
+    return *sessions_[session.id];
+  }
+
+  std::atomic<MetricsLevel> metrics_level_{MetricsLevel::BASIC};
+  mutable std::shared_mutex bind_mutex_;
+  mutable std::vector<std::string> functions_;
+  mutable std::vector<std::optional<Binding>> bindings_;
+  mutable std::vector<std::optional<Session>> sessions_;
 };
 
 enum class DeviceRunTarget {
@@ -59,9 +375,48 @@ std::ostream &operator<<(std::ostream &os, const DeviceRunTarget &t);
 std::unique_ptr<Executor> CreateExecutor(
     const std::vector<uint8_t>& serialized_module, DeviceRunTarget device_run_target);
 
+/**
+ * @brief Creates an executor whose intermediate activations are placed in a single arena following the
+ * plan produced by ir::SerializeMemoryPlan (see mdna_ir_memory.h).
+ */
+std::unique_ptr<Executor> CreateExecutor(
+    const std::vector<uint8_t>& serialized_module, DeviceRunTarget device_run_target,
+    const std::vector<uint8_t>& serialized_memory_plan);
+
+/**
+ * @brief Creates an executor for a module compiled from one whose constants were externalized into 'weights'
+ * (see mdna_ir_weights.h and compile::CompileOptions::weights). Payloads are read from 'weights', which the executor keeps
+ * alive, instead of being copied into it, so every executor created from one memory mapped section, e.g. the one
+ * of ir::LoadModule(), shares a single copy of the weights.
+ */
+std::unique_ptr<Executor> CreateExecutor(
+    const std::vector<uint8_t>& serialized_module, DeviceRunTarget device_run_target,
+    std::shared_ptr<const ir::WeightSection> weights);
+
+/**
+ * @brief Creates an executor reading the serialized module incrementally from 'serialized_module', so the
+ * whole compiled module never needs to be held in memory next to the deserialized one.
+ */
+std::unique_ptr<Executor> CreateExecutor(std::istream& serialized_module, DeviceRunTarget device_run_target);
+
+/**
+ * @brief Creates an executor from a compiled module file, as written by compile::CompileToFile().
+ */
+inline std::unique_ptr<Executor> CreateExecutorFromFile(const std::string& path, DeviceRunTarget device_run_target) {
+  std::ifstream is(path, std::ios::binary);
+  if (!is) {
+    throw std::runtime_error("Could not open " + path);
+  }
+  return CreateExecutor(is, device_run_target);
+}
+
 ExecutorMetrics Execute(const Executor* executor, const std::string& function,
                         std::vector<void*>& args);
 
+/**
+ * @brief Runs 'function' of 'serialized_module' on the default target, creating a new executor on every call. Use
+ * the overload taking a DeviceRunTarget in mdna_execute_cache.h to reuse executors across calls.
+ */
 ExecutorMetrics Execute(const std::vector<uint8_t>& serialized_module,
                         const std::string& function, std::vector<void*>& args);
 
@@ -0,0 +1,273 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_EXECUTE_ASYNC_H
+#define MDNA_EXECUTE_ASYNC_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mdna_execute.h"
+
+/**
+ * @file mdna_execute_async.h
+ * @brief Asynchronous runs with a bounded number of requests in flight, on top of execute::Executor.
+ */
+namespace mera {
+namespace execute {
+
+namespace detail {
+
+/**
+ * @brief Bounded work queue behind AsyncExecutor. Worker threads are started on demand, up to the in-flight
+ * depth, and Submit() blocks while 'depth' requests are queued or running.
+ */
+class AsyncQueue {
+ public:
+  /**
+   * @brief A queued request. 'cancel' is called instead of 'run' when the queue stops before the request started.
+   */
+  struct Task {
+    std::function<void()> run;
+    std::function<void()> cancel;
+  };
+
+  explicit AsyncQueue(size_t depth): depth_(depth) {}
+
+  ~AsyncQueue() { Stop(); }
+
+  void SetDepth(size_t depth) {
+    if (depth == 0) {
+      throw std::logic_error("In-flight depth must be at least 1");
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    depth_ = depth;
+    cv_.notify_all();
+  }
+
+  size_t Depth() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return depth_;
+  }
+
+  void Submit(Task task) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stop_) {
+      throw std::runtime_error("AsyncExecutor is shutting down");
+    }
+    // A worker waiting for a free slot would wait for itself, as its own request is still in flight
+    if (CurrentQueue() == this && in_flight_ >= depth_) {
+      throw std::logic_error("RunAsync() called from a completion callback while the in-flight depth (" +
+                             std::to_string(depth_) + ") is reached");
+    }
+    cv_.wait(lock, [&] { return stop_ || in_flight_ < depth_; });
+    if (stop_) {
+      throw std::runtime_error("AsyncExecutor is shutting down");
+    }
+    ++in_flight_;
+    tasks_.push_back(std::move(task));
+    if (idle_ == 0 && threads_.size() < depth_) {
+      threads_.emplace_back([this] { Work(); });
+    }
+    cv_.notify_all();
+  }
+
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // The calling request is still in flight, so in_flight_ would never drop to 0
+    if (CurrentQueue() == this) {
+      throw std::logic_error("WaitAll() called from a completion callback");
+    }
+    cv_.wait(lock, [&] { return in_flight_ == 0; });
+  }
+
+  /**
+   * @brief Rejects later submissions, cancels the requests that have not started and waits for the running ones.
+   * Must not be called from a completion callback.
+   */
+  void Stop() {
+    std::deque<Task> pending;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+      pending.swap(tasks_);
+      in_flight_ -= pending.size();
+    }
+    cv_.notify_all();
+    for (auto &task : pending) {
+      task.cancel();
+    }
+    // No thread is started once stop_ is set, so threads_ is stable here
+    for (auto &t : threads_) {
+      if (t.joinable()) {
+        t.join();
+      }
+    }
+  }
+
+ private:
+  static const AsyncQueue *&CurrentQueue() {
+    thread_local const AsyncQueue *queue = nullptr;
+    return queue;
+  }
+
+  void Work() {
+    CurrentQueue() = this;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      ++idle_;
+      cv_.wait(lock, [&] { return stop_ || !tasks_.empty(); });
+      --idle_;
+      if (tasks_.empty()) {
+        return;
+      }
+      auto task = std::move(tasks_.front());
+      tasks_.pop_front();
+      lock.unlock();
+      task.run();
+      lock.lock();
+      --in_flight_;
+      cv_.notify_all();
+    }
+  }
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Task> tasks_;
+  std::vector<std::thread> threads_;
+  size_t depth_;
+  size_t in_flight_{0};
+  size_t idle_{0};
+  bool stop_{false};
+};
+
+}  // namespace detail
+
+/**
+ * @brief Owns an Executor and runs its functions asynchronously, so a serving thread can overlap its own pre and
+ * post processing with execution. Requests are run with Executor::Run() on host threads, one per in-flight request.
+ *
+ * RunAsync(), SetMaxInFlight() and WaitAll() are thread safe. Destroying an AsyncExecutor with requests pending is
+ * safe: requests that have not started complete with an error and running ones are waited for before the Executor
+ * is destroyed. An AsyncExecutor must not be destroyed from one of its own completion callbacks.
+ */
+class AsyncExecutor {
+ public:
+  /**
+   * @brief Completion callback of RunAsync(). 'error' is set when the run failed, in which case 'metrics' is
+   * empty. It is called from a host thread of the AsyncExecutor and must not throw. It may call RunAsync() again,
+   * which throws std::logic_error if the in-flight depth is reached, as waiting there would never end, and must not
+   * call WaitAll() for the same reason.
+   */
+  using Callback = std::function<void(ExecutorMetrics metrics, std::exception_ptr error)>;
+
+  explicit AsyncExecutor(std::unique_ptr<Executor> executor, size_t max_in_flight = 1):
+    executor_(std::move(executor)), queue_(max_in_flight) {
+    if (!executor_) {
+      throw std::invalid_argument("AsyncExecutor needs an executor");
+    }
+    queue_.SetDepth(max_in_flight);
+  }
+
+  /**
+   * @brief Creates the underlying executor with CreateExecutor().
+   */
+  static std::unique_ptr<AsyncExecutor> Create(const std::vector<uint8_t>& serialized_module,
+                                               DeviceRunTarget device_run_target, size_t max_in_flight = 1) {
+    return std::make_unique<AsyncExecutor>(CreateExecutor(serialized_module, device_run_target), max_in_flight);
+  }
+
+  /**
+   * @brief Cancels the requests that have not started and waits for the running ones, then destroys the executor.
+   */
+  ~AsyncExecutor() { queue_.Stop(); }
+
+  /**
+   * @brief Queues a run of 'function' and returns immediately, unless the in-flight depth is reached, in which
+   * case it blocks until a previous request completes. The buffers pointed to by 'args' must stay valid until
+   * 'done' is called. Throws std::runtime_error once the AsyncExecutor is being destroyed.
+   */
+  void RunAsync(const std::string& function, std::vector<void*> args, Callback done) {
+    auto shared_done = std::make_shared<Callback>(std::move(done));
+    detail::AsyncQueue::Task task;
+    task.run = [this, function, args = std::move(args), shared_done]() mutable {
+      ExecutorMetrics metrics;
+      std::exception_ptr error;
+      try {
+        metrics = executor_->Run(function, args);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      (*shared_done)(std::move(metrics), error);
+    };
+    task.cancel = [shared_done] {
+      (*shared_done)(ExecutorMetrics(), std::make_exception_ptr(
+          std::runtime_error("AsyncExecutor destroyed before the asynchronous request ran")));
+    };
+    queue_.Submit(std::move(task));
+  }
+
+  /**
+   * @brief Same as above, but the result is delivered through a future. Errors are rethrown by future::get().
+   */
+  std::future<ExecutorMetrics> RunAsync(const std::string& function, std::vector<void*> args) {
+    auto promise = std::make_shared<std::promise<ExecutorMetrics>>();
+    auto future = promise->get_future();
+    RunAsync(function, std::move(args), [promise](ExecutorMetrics metrics, std::exception_ptr error) {
+      if (error) {
+        promise->set_exception(error);
+      } else {
+        promise->set_value(std::move(metrics));
+      }
+    });
+    return future;
+  }
+
+  /**
+   * @brief Sets the maximum number of requests queued or running at once.
+   */
+  void SetMaxInFlight(size_t depth) { queue_.SetDepth(depth); }
+  size_t MaxInFlight() const { return queue_.Depth(); }
+
+  /**
+   * @brief Blocks until every request submitted so far has completed. Throws std::logic_error when called from a
+   * completion callback.
+   */
+  void WaitAll() { queue_.Wait(); }
+
+  /**
+   * @brief The wrapped executor, e.g. for synchronous runs next to the asynchronous ones.
+   */
+  const Executor &Get() const { return *executor_; }
+
+ private:
+  // Declared first so it outlives the queue, whose threads call it
+  const std::unique_ptr<Executor> executor_;
+  detail::AsyncQueue queue_;
+};
+
+}  // namespace execute
+}  // namespace mera
+
+#endif  // MDNA_EXECUTE_ASYNC_H
@@ -0,0 +1,248 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_EXECUTE_BATCHING_H
+#define MDNA_EXECUTE_BATCHING_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mdna_execute.h"
+
+/**
+ * @file mdna_execute_batching.h
+ * @brief Dynamic batching of single item requests onto a function compiled with a fixed batch size.
+ */
+namespace mera {
+namespace execute {
+
+/**
+ * @brief Layout of the batched function. Its arguments are the input buffers followed by the output buffers,
+ * each one holding 'max_batch' items of the given size back to back.
+ */
+struct BatchingOptions {
+  // Batch size the function was compiled with
+  size_t max_batch{1};
+  // Longest time the oldest queued request waits for the batch to fill up before a partial batch is run
+  std::chrono::microseconds max_wait{1000};
+  // Size in bytes of a single item of every input and every output
+  std::vector<size_t> input_item_bytes;
+  std::vector<size_t> output_item_bytes;
+};
+
+/**
+ * @brief Histogram with fixed upper bounds. counts[i] is the number of samples in (bounds[i-1], bounds[i]], the
+ * last count holds the samples above the last bound.
+ */
+struct Histogram {
+  std::vector<double> bounds;
+  std::vector<uint64_t> counts;
+  uint64_t total{0};
+  double sum{0};
+
+  explicit Histogram(std::vector<double> b = {}): bounds(std::move(b)), counts(bounds.size() + 1, 0) {}
+
+  void Add(double value) {
+    const size_t i = std::lower_bound(bounds.begin(), bounds.end(), value) - bounds.begin();
+    ++counts[i];
+    ++total;
+    sum += value;
+  }
+
+  double Mean() const { return total == 0 ? 0 : sum / total; }
+};
+
+struct BatchingStats {
+  uint64_t requests{0};
+  uint64_t batches{0};
+  // Number of requests per executed batch, one bucket per batch size
+  Histogram batch_size;
+  // Time from Submit() to the start of the batch holding the request, in microseconds
+  Histogram queue_wait_us;
+};
+
+/**
+ * @brief Collects single item requests into batches of up to 'max_batch' items, runs them on 'executor' and
+ * scatters the outputs back. A batch is run as soon as it is full, or once its oldest request waited for
+ * 'max_wait'. Unused slots of a partial batch keep stale data and their outputs are discarded.
+ * Submit() is thread safe.
+ */
+class BatchingExecutor {
+ public:
+  BatchingExecutor(std::unique_ptr<Executor> executor, std::string function, BatchingOptions opts):
+    executor_(std::move(executor)), function_(std::move(function)), opts_(std::move(opts)) {
+    if (opts_.max_batch == 0) {
+      throw std::logic_error("max_batch must be at least 1");
+    }
+    std::vector<double> sizes;
+    for (size_t b = 1; b <= opts_.max_batch; ++b) {
+      sizes.push_back(double(b));
+    }
+    stats_.batch_size = Histogram(sizes);
+    std::vector<double> waits;
+    for (double us = 10; us < 1e7; us *= 2) {
+      waits.push_back(us);
+    }
+    stats_.queue_wait_us = Histogram(waits);
+    for (const size_t n : opts_.input_item_bytes) {
+      buffers_.emplace_back(n * opts_.max_batch);
+    }
+    for (const size_t n : opts_.output_item_bytes) {
+      buffers_.emplace_back(n * opts_.max_batch);
+    }
+    worker_ = std::thread([this] { Work(); });
+  }
+
+  /**
+   * @brief Creates the underlying executor with CreateExecutor().
+   */
+  static std::unique_ptr<BatchingExecutor> Create(const std::vector<uint8_t>& serialized_module,
+                                                  DeviceRunTarget device_run_target, std::string function,
+                                                  BatchingOptions opts) {
+    return std::make_unique<BatchingExecutor>(CreateExecutor(serialized_module, device_run_target),
+                                              std::move(function), std::move(opts));
+  }
+
+  /**
+   * @brief Runs all queued requests, then stops.
+   */
+  ~BatchingExecutor() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+  }
+
+  /**
+   * @brief Queues one request. 'inputs' and 'outputs' hold one item each and must stay valid until the returned
+   * future is ready. Errors of the batch run are rethrown by future::get().
+   */
+  std::future<void> Submit(std::vector<const void*> inputs, std::vector<void*> outputs) {
+    if (inputs.size() != opts_.input_item_bytes.size() || outputs.size() != opts_.output_item_bytes.size()) {
+      throw std::invalid_argument("Expected " + std::to_string(opts_.input_item_bytes.size()) + " inputs and " +
+                                  std::to_string(opts_.output_item_bytes.size()) + " outputs");
+    }
+    Request r{std::move(inputs), std::move(outputs), std::chrono::steady_clock::now(), {}};
+    auto future = r.done.get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stop_) {
+        throw std::logic_error("BatchingExecutor is shutting down");
+      }
+      queue_.push_back(std::move(r));
+    }
+    cv_.notify_all();
+    return future;
+  }
+
+  BatchingStats Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+ private:
+  struct Request {
+    std::vector<const void*> inputs;
+    std::vector<void*> outputs;
+    std::chrono::steady_clock::time_point submitted;
+    std::promise<void> done;
+  };
+
+  void Work() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      cv_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      const auto deadline = queue_.front().submitted + opts_.max_wait;
+      cv_.wait_until(lock, deadline, [&] { return stop_ || queue_.size() >= opts_.max_batch; });
+
+      std::vector<Request> batch;
+      const auto start = std::chrono::steady_clock::now();
+      while (!queue_.empty() && batch.size() < opts_.max_batch) {
+        batch.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+      }
+      ++stats_.batches;
+      stats_.requests += batch.size();
+      stats_.batch_size.Add(double(batch.size()));
+      for (const auto &r : batch) {
+        stats_.queue_wait_us.Add(std::chrono::duration<double, std::micro>(start - r.submitted).count());
+      }
+      lock.unlock();
+      RunBatch(batch);
+      lock.lock();
+    }
+  }
+
+  void RunBatch(std::vector<Request> &batch) {
+    const size_t num_in = opts_.input_item_bytes.size();
+    std::vector<void*> args;
+    for (auto &b : buffers_) {
+      args.push_back(b.data());
+    }
+    for (size_t slot = 0; slot < batch.size(); ++slot) {
+      for (size_t i = 0; i < num_in; ++i) {
+        const size_t n = opts_.input_item_bytes[i];
+        std::memcpy(buffers_[i].data() + slot * n, batch[slot].inputs[i], n);
+      }
+    }
+    try {
+      executor_->Run(function_, args);
+    } catch (...) {
+      for (auto &r : batch) {
+        r.done.set_exception(std::current_exception());
+      }
+      return;
+    }
+    for (size_t slot = 0; slot < batch.size(); ++slot) {
+      for (size_t o = 0; o < opts_.output_item_bytes.size(); ++o) {
+        const size_t n = opts_.output_item_bytes[o];
+        std::memcpy(batch[slot].outputs[o], buffers_[num_in + o].data() + slot * n, n);
+      }
+      batch[slot].done.set_value();
+    }
+  }
+
+  const std::unique_ptr<Executor> executor_;
+  const std::string function_;
+  const BatchingOptions opts_;
+  std::vector<std::vector<uint8_t>> buffers_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Request> queue_;
+  BatchingStats stats_;
+  bool stop_{false};
+  std::thread worker_;
+};
+
+}  // namespace execute
+}  // namespace mera
+
+#endif  // MDNA_EXECUTE_BATCHING_H
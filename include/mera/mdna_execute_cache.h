@@ -0,0 +1,192 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_EXECUTE_CACHE_H
+#define MDNA_EXECUTE_CACHE_H
+
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "mdna_execute.h"
+
+/**
+ * @file mdna_execute_cache.h
+ * @brief In-process cache of executors, keyed by the content of the serialized module and the device target.
+ */
+namespace mera {
+namespace execute {
+
+namespace detail {
+
+/**
+ * @brief 128-bit hash of 'size' bytes, processed 8 bytes at a time so hashing stays cheap next to
+ * deserialization even for large modules.
+ */
+inline std::pair<uint64_t, uint64_t> HashModuleBytes(const uint8_t *data, size_t size) {
+  uint64_t h1 = 0x9e3779b97f4a7c15ull ^ size;
+  uint64_t h2 = 0xc2b2ae3d27d4eb4full + size;
+  auto mix = [](uint64_t h, uint64_t v, uint64_t k) {
+    h ^= v * k;
+    h = (h << 31) | (h >> 33);
+    return h * 0x94d049bb133111ebull;
+  };
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t v;
+    std::memcpy(&v, data + i, 8);
+    h1 = mix(h1, v, 0xff51afd7ed558ccdull);
+    h2 = mix(h2, v, 0xc4ceb9fe1a85ec53ull);
+  }
+  uint64_t tail = 0;
+  if (i < size) {
+    std::memcpy(&tail, data + i, size - i);
+  }
+  h1 = mix(h1, tail, 0xff51afd7ed558ccdull);
+  h2 = mix(h2, tail, 0xc4ceb9fe1a85ec53ull);
+  return {h1 ^ (h1 >> 29), h2 ^ (h2 >> 32)};
+}
+
+}  // namespace detail
+
+struct ExecutorCacheStats {
+  uint64_t hits{0};
+  uint64_t misses{0};
+  uint64_t evictions{0};
+  uint64_t entries{0};
+  uint64_t bytes{0};
+};
+
+/**
+ * @brief LRU cache of executors. Each entry is charged the size of its serialized module, as an estimate of the
+ * memory held by the executor, and the least recently used entries are evicted once the total exceeds the
+ * capacity. Executors are handed out as shared pointers, so evicting one never invalidates a caller still
+ * using it. All methods are thread safe.
+ */
+class ExecutorCache {
+ public:
+  static constexpr uint64_t kDefaultCapacity = 1ull << 30;
+
+  explicit ExecutorCache(uint64_t capacity_bytes = kDefaultCapacity): capacity_(capacity_bytes) {}
+
+  /**
+   * @brief Process wide cache backing Execute(serialized_module, device_run_target, ...) below.
+   */
+  static ExecutorCache &Global() {
+    static ExecutorCache cache;
+    return cache;
+  }
+
+  /**
+   * @brief Returns the cached executor for 'serialized_module' on 'device_run_target', creating it on a miss.
+   * Creation happens outside the cache lock, so concurrent misses on different modules do not serialize.
+   */
+  std::shared_ptr<const Executor> Get(const std::vector<uint8_t>& serialized_module,
+                                      DeviceRunTarget device_run_target) {
+    const auto [h1, h2] = detail::HashModuleBytes(serialized_module.data(), serialized_module.size());
+    const Key key{h1, h2, serialized_module.size(), int(device_run_target)};
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = index_.find(key);
+      if (it != index_.end()) {
+        ++stats_.hits;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->executor;
+      }
+      ++stats_.misses;
+    }
+    std::shared_ptr<const Executor> executor = CreateExecutor(serialized_module, device_run_target);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      // Another thread created the same executor meanwhile, keep the first one
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return it->second->executor;
+    }
+    lru_.push_front(Entry{key, executor, serialized_module.size()});
+    index_.emplace(key, lru_.begin());
+    stats_.bytes += serialized_module.size();
+    Evict();
+    return executor;
+  }
+
+  void SetCapacity(uint64_t capacity_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = capacity_bytes;
+    Evict();
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.evictions += lru_.size();
+    lru_.clear();
+    index_.clear();
+    stats_.bytes = 0;
+  }
+
+  ExecutorCacheStats Stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ExecutorCacheStats s = stats_;
+    s.entries = lru_.size();
+    return s;
+  }
+
+ private:
+  using Key = std::tuple<uint64_t, uint64_t, size_t, int>;
+
+  struct Entry {
+    Key key;
+    std::shared_ptr<const Executor> executor;
+    uint64_t bytes;
+  };
+
+  // Always keeps the most recent entry, even when it alone exceeds the capacity
+  void Evict() {
+    while (stats_.bytes > capacity_ && lru_.size() > 1) {
+      const Entry &e = lru_.back();
+      stats_.bytes -= e.bytes;
+      index_.erase(e.key);
+      lru_.pop_back();
+      ++stats_.evictions;
+    }
+  }
+
+  mutable std::mutex mutex_;
+  uint64_t capacity_;
+  std::list<Entry> lru_;
+  std::map<Key, std::list<Entry>::iterator> index_;
+  ExecutorCacheStats stats_;
+};
+
+/**
+ * @brief Runs 'function' of 'serialized_module' through ExecutorCache::Global(), so repeated calls with the same
+ * module deserialize it and set up the device only once.
+ */
+inline ExecutorMetrics Execute(const std::vector<uint8_t>& serialized_module, DeviceRunTarget device_run_target,
+                               const std::string& function, std::vector<void*>& args) {
+  return ExecutorCache::Global().Get(serialized_module, device_run_target)->Run(function, args);
+}
+
+}  // namespace execute
+}  // namespace mera
+
+#endif  // MDNA_EXECUTE_CACHE_H
@@ -0,0 +1,440 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_EXECUTE_POOL_H
+#define MDNA_EXECUTE_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "mdna_execute.h"
+
+/**
+ * @file mdna_execute_pool.h
+ * @brief Pool of host executors (DeviceRunTarget::NONE) running requests in parallel on pinned cores.
+ */
+namespace mera {
+namespace execute {
+
+/**
+ * @brief Creates an executor sharing the read-only state of 'prototype' (deserialized module and weights), with
+ * its own activation memory. The activation memory is allocated by the calling thread, so on NUMA systems it
+ * lands on the node of that thread.
+ */
+std::unique_ptr<Executor> CreateExecutorReplica(const Executor& prototype);
+
+namespace detail {
+
+/**
+ * @brief Bounded lock-free multi-producer multi-consumer queue. 'capacity' is rounded up to a power of two.
+ */
+template <typename T>
+class MpmcQueue {
+ public:
+  explicit MpmcQueue(size_t capacity) {
+    size_t n = 2;
+    while (n < capacity) { n <<= 1; }
+    mask_ = n - 1;
+    cells_.reset(new Cell[n]);
+    for (size_t i = 0; i < n; ++i) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool TryPush(T value) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    while (true) {
+      Cell &c = cells_[pos & mask_];
+      const intptr_t diff = intptr_t(c.seq.load(std::memory_order_acquire)) - intptr_t(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          c.value = std::move(value);
+          c.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool TryPop(T &value) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    while (true) {
+      Cell &c = cells_[pos & mask_];
+      const intptr_t diff = intptr_t(c.seq.load(std::memory_order_acquire)) - intptr_t(pos + 1);
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          value = std::move(c.value);
+          c.seq.store(pos + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_;
+  alignas(64) std::atomic<size_t> tail_{0};
+  alignas(64) std::atomic<size_t> head_{0};
+};
+
+/**
+ * @brief Parses a sysfs cpu list such as "0-3,8,10-11".
+ */
+inline std::vector<int> ParseCpuList(const std::string &list) {
+  std::vector<int> cpus;
+  std::istringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || range == "\n") {
+      continue;
+    }
+    const size_t dash = range.find('-');
+    const int first = std::stoi(range.substr(0, dash));
+    const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int c = first; c <= last; ++c) {
+      cpus.push_back(c);
+    }
+  }
+  return cpus;
+}
+
+inline std::string ReadFirstLine(const std::string &path) {
+  std::ifstream is(path);
+  std::string line;
+  std::getline(is, line);
+  return line;
+}
+
+struct NumaNode {
+  // Node id as named by sysfs, node ids need not be contiguous
+  int id;
+  std::vector<int> cpus;
+};
+
+/**
+ * @brief Online NUMA nodes with the cpus of each one this process may run on, from sysfs and the affinity mask
+ * of the calling thread. Nodes without such cpus are left out. Falls back to a single node 0 holding all cpus.
+ */
+inline std::vector<NumaNode> NumaNodeCpus() {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  const bool has_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+  auto usable = [&](int c) { return c >= 0 && c < CPU_SETSIZE && (!has_mask || CPU_ISSET(c, &allowed)); };
+
+  std::vector<NumaNode> nodes;
+  for (const int id : ParseCpuList(ReadFirstLine("/sys/devices/system/node/online"))) {
+    NumaNode node{id, {}};
+    for (const int c : ParseCpuList(ReadFirstLine("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist"))) {
+      if (usable(c)) {
+        node.cpus.push_back(c);
+      }
+    }
+    if (!node.cpus.empty()) {
+      nodes.push_back(std::move(node));
+    }
+  }
+  if (nodes.empty()) {
+    nodes.push_back({0, {}});
+    for (unsigned c = 0; c < std::max(1u, std::thread::hardware_concurrency()); ++c) {
+      if (usable(int(c))) {
+        nodes.back().cpus.push_back(int(c));
+      }
+    }
+  }
+  return nodes;
+}
+
+}  // namespace detail
+
+struct ExecutorPoolOptions {
+  // Number of replicas. 0 uses one replica per 'cores_per_replica' available cores
+  size_t num_replicas{0};
+  size_t cores_per_replica{1};
+  // Keeps the cores of each replica within one NUMA node and spreads replicas across nodes in proportion to their
+  // cores
+  bool numa_aware{true};
+  // Pin every replica thread to its core set
+  bool pin_threads{true};
+  size_t queue_capacity{1024};
+};
+
+struct ReplicaStats {
+  std::vector<int> cpus;
+  // sysfs id of the node holding 'cpus', -1 when the pool is not NUMA aware
+  int numa_node{-1};
+  uint64_t requests{0};
+  uint64_t errors{0};
+  std::chrono::nanoseconds busy_time{0};
+};
+
+/**
+ * @brief Runs requests on a pool of replicas of one host executor. Replicas share a single copy of the module
+ * and weights, each one is driven by its own thread, and all of them pull from one lock-free request queue.
+ * Replicas never share cores: the constructor throws when 'num_replicas' replicas of 'cores_per_replica' cores do
+ * not fit on the available cpus. Submit() is thread safe.
+ */
+class ExecutorPool {
+ public:
+  ExecutorPool(const std::vector<uint8_t>& serialized_module, ExecutorPoolOptions opts = {}):
+    opts_(opts), queue_(opts.queue_capacity) {
+    if (opts_.cores_per_replica == 0) {
+      throw std::logic_error("cores_per_replica must be at least 1");
+    }
+    prototype_ = CreateExecutor(serialized_module, DeviceRunTarget::NONE);
+    Place();
+    for (size_t r = 0; r < stats_.size(); ++r) {
+      workers_.emplace_back([this, r] { Work(r); });
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [&] { return ready_ == workers_.size(); });
+    if (init_error_) {
+      lock.unlock();
+      Shutdown();
+      std::rethrow_exception(init_error_);
+    }
+  }
+
+  /**
+   * @brief Runs all queued requests, then stops the replicas.
+   */
+  ~ExecutorPool() { Shutdown(); }
+
+  /**
+   * @brief Queues a run of 'function'. Blocks while the queue is full. The buffers pointed to by 'args' must
+   * stay valid until the returned future is ready. Throws once the pool is shutting down.
+   */
+  std::future<ExecutorMetrics> Submit(const std::string& function, std::vector<void*> args) {
+    auto task = std::make_unique<Task>(Task{function, std::move(args), {}});
+    auto future = task->done.get_future();
+    // Counted as pending before checking for shutdown, so replicas keep running until it has been queued
+    pending_.fetch_add(1);
+    if (stop_.load()) {
+      pending_.fetch_sub(1);
+      throw std::runtime_error("ExecutorPool is shutting down");
+    }
+    Task *t = task.release();
+    while (!queue_.TryPush(t)) {
+      std::this_thread::yield();
+    }
+    if (sleeping_.load() > 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cv_.notify_one();
+    }
+    return future;
+  }
+
+  size_t NumReplicas() const { return workers_.size(); }
+
+  std::vector<ReplicaStats> Stats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+  }
+
+ private:
+  struct Task {
+    std::string function;
+    std::vector<void*> args;
+    std::promise<ExecutorMetrics> done;
+  };
+
+  /**
+   * @brief Gives every replica its own 'cores_per_replica' cpus. When NUMA aware each node offers as many slots as
+   * it has whole core sets, and replicas go to the node with the fewest replicas per slot, so nodes fill in
+   * proportion to their cpus.
+   */
+  void Place() {
+    std::vector<detail::NumaNode> domains = detail::NumaNodeCpus();
+    if (!opts_.numa_aware) {
+      detail::NumaNode all{-1, {}};
+      for (const auto &n : domains) {
+        all.cpus.insert(all.cpus.end(), n.cpus.begin(), n.cpus.end());
+      }
+      domains = {std::move(all)};
+    }
+    std::vector<size_t> slots(domains.size());
+    size_t total_slots = 0;
+    for (size_t d = 0; d < domains.size(); ++d) {
+      slots[d] = domains[d].cpus.size() / opts_.cores_per_replica;
+      total_slots += slots[d];
+    }
+    const size_t n = opts_.num_replicas > 0 ? opts_.num_replicas : total_slots;
+    if (n == 0 || n > total_slots) {
+      throw std::runtime_error("Cannot place " + std::to_string(std::max<size_t>(n, 1)) + " replicas of " +
+                               std::to_string(opts_.cores_per_replica) + " cores without sharing cores: only " +
+                               std::to_string(total_slots) + " fit on the available cpus" +
+                               (opts_.numa_aware ? " within NUMA nodes" : ""));
+    }
+    std::vector<size_t> used(domains.size(), 0);
+    for (size_t r = 0; r < n; ++r) {
+      size_t best = domains.size();
+      for (size_t d = 0; d < domains.size(); ++d) {
+        if (used[d] == slots[d]) {
+          continue;
+        }
+        // Lowest share of its slots once the replica is added: (used + 1) / slots, cross multiplied
+        if (best == domains.size() || (used[d] + 1) * slots[best] < (used[best] + 1) * slots[d]) {
+          best = d;
+        }
+      }
+      const auto &cpus = domains[best].cpus;
+      ReplicaStats s;
+      s.cpus.assign(cpus.begin() + used[best] * opts_.cores_per_replica,
+                    cpus.begin() + (used[best] + 1) * opts_.cores_per_replica);
+      s.numa_node = domains[best].id;
+      ++used[best];
+      stats_.push_back(std::move(s));
+    }
+  }
+
+  void Work(size_t r) {
+    std::unique_ptr<Executor> replica;
+    try {
+      if (opts_.pin_threads) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const int c : stats_[r].cpus) {
+          if (c < 0 || c >= CPU_SETSIZE) {
+            throw std::runtime_error("Cpu " + std::to_string(c) + " is out of the range of cpu_set_t");
+          }
+          CPU_SET(c, &set);
+        }
+        if (const int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+          throw std::runtime_error("Could not pin replica " + std::to_string(r) + ": " + std::strerror(err));
+        }
+      }
+      // Created after pinning, so the activation memory of the replica is local to its node
+      replica = CreateExecutorReplica(*prototype_);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!init_error_) {
+        init_error_ = std::current_exception();
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++ready_;
+      cv_.notify_all();
+    }
+    if (!replica) {
+      return;
+    }
+
+    while (true) {
+      Task *t = nullptr;
+      if (!queue_.TryPop(t)) {
+        if (!Idle()) {
+          return;
+        }
+        continue;
+      }
+      pending_.fetch_sub(1);
+      std::unique_ptr<Task> task(t);
+      const auto start = std::chrono::steady_clock::now();
+      bool failed = false;
+      try {
+        task->done.set_value(replica->Run(task->function, task->args));
+      } catch (...) {
+        failed = true;
+        task->done.set_exception(std::current_exception());
+      }
+      const auto elapsed = std::chrono::steady_clock::now() - start;
+      std::lock_guard<std::mutex> lock(stats_mutex_);
+      ++stats_[r].requests;
+      stats_[r].errors += failed ? 1 : 0;
+      stats_[r].busy_time += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+    }
+  }
+
+  /**
+   * @brief Waits for work after a failed pop: spins briefly, then sleeps. Returns false once stopping with an
+   * empty queue.
+   */
+  bool Idle() {
+    for (int i = 0; i < 64; ++i) {
+      if (pending_.load() > 0) {
+        return true;
+      }
+      std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    sleeping_.fetch_add(1);
+    cv_.wait_for(lock, std::chrono::milliseconds(10), [&] { return stop_.load() || pending_.load() > 0; });
+    sleeping_.fetch_sub(1);
+    return !(stop_.load() && pending_.load() == 0);
+  }
+
+  void Shutdown() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stop_.exchange(true)) {
+        return;
+      }
+    }
+    cv_.notify_all();
+    for (auto &w : workers_) {
+      w.join();
+    }
+  }
+
+  const ExecutorPoolOptions opts_;
+  std::unique_ptr<Executor> prototype_;
+  detail::MpmcQueue<Task*> queue_;
+  std::atomic<size_t> pending_{0};
+  std::atomic<size_t> sleeping_{0};
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  size_t ready_{0};
+  std::atomic<bool> stop_{false};
+  std::exception_ptr init_error_;
+
+  mutable std::mutex stats_mutex_;
+  std::vector<ReplicaStats> stats_;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace execute
+}  // namespace mera
+
+#endif  // MDNA_EXECUTE_POOL_H
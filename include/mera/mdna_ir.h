@@ -16,8 +16,10 @@
 #ifndef MDNA_IR_H
 #define MDNA_IR_H
 
+#include <optional>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "nop/serializer.h"
@@ -27,6 +29,18 @@
 namespace mera {
 namespace ir {
 
+/**
+ * @brief 64-bit FNV-1a hash of a byte buffer, chained through 'seed'.
+ */
+inline uint64_t HashBytes(const void *data, size_t size, uint64_t seed = 14695981039346656037ull) {
+  const uint8_t *bytes = static_cast<const uint8_t*>(data);
+  uint64_t h = seed;
+  for (size_t i = 0; i < size; ++i) {
+    h = (h ^ bytes[i]) * 1099511628211ull;
+  }
+  return h;
+}
+
 // attributes
 struct Dilations {
   int h;
@@ -48,13 +62,89 @@ struct Strides {
   NOP_STRUCTURE(Strides, h, w);
 };
 
+/**
+ * @brief Compact handle of a tensor inside its Graph. The human readable name is interned in the
+ * Graph's SymbolTable and should only be needed for printing and debugging.
+ */
+using TensorId = int32_t;
+
+constexpr TensorId kInvalidTensorId = -1;
+
 struct Tensor {
   DataType type{};
   Shape shape{};
-  std::string id;
+  TensorId id{kInvalidTensorId};
   NOP_STRUCTURE(Tensor, type, shape, id);
 };
 
+/**
+ * @brief Per Graph table mapping each TensorId to its name. Ids are dense and assigned in creation order.
+ */
+struct SymbolTable {
+  std::vector<std::string> names;
+  NOP_STRUCTURE(SymbolTable, names);
+
+  /**
+   * @brief Registers a new name and returns its handle. Names are expected to be unique.
+   */
+  TensorId Intern(const std::string &name) {
+    if (indexed_ != names.size()) {
+      BuildLookup();
+    }
+    const TensorId id = TensorId(names.size());
+    names.push_back(name);
+    lookup_.emplace(names.back(), id);
+    ++indexed_;
+    return id;
+  }
+
+  /**
+   * @brief Returns the name of the tensor with handle 'id'. Error if the id is not part of this table.
+   */
+  const std::string &NameOf(TensorId id) const {
+    if (id < 0 || size_t(id) >= names.size()) {
+      throw std::out_of_range("Unknown tensor id " + std::to_string(id));
+    }
+    return names[id];
+  }
+
+  /**
+   * @brief Reverse lookup of a tensor handle from its name. Only meant for debugging and tooling. Does not modify
+   * the table, so concurrent calls on a const Graph are safe; on a deserialized table it scans 'names' until
+   * BuildLookup() or the next Intern().
+   */
+  std::optional<TensorId> Find(const std::string &name) const {
+    if (indexed_ == names.size()) {
+      const auto it = lookup_.find(name);
+      return it != lookup_.end() ? std::optional<TensorId>(it->second) : std::nullopt;
+    }
+    for (size_t i = 0; i < names.size(); ++i) {
+      if (names[i] == name) {
+        return TensorId(i);
+      }
+    }
+    return std::nullopt;
+  }
+
+  /**
+   * @brief Indexes 'names' for Find(). Meant to be called once after deserialization, which only fills 'names'.
+   */
+  void BuildLookup() {
+    lookup_.clear();
+    for (size_t i = 0; i < names.size(); ++i) {
+      lookup_.emplace(names[i], TensorId(i));
+    }
+    indexed_ = names.size();
+  }
+
+  size_t Size() const { return names.size(); }
+
+ private:
+  // Kept up to date by Intern(), not serialized. 'indexed_' is the number of names it covers
+  std::unordered_map<std::string, TensorId> lookup_;
+  size_t indexed_{0};
+};
+
 struct QuantizationParameter {
   float scale;
   int zero_point;
@@ -71,6 +161,18 @@ struct Var {
   NOP_STRUCTURE(Var, output);
 };
 
+/**
+ * @brief Location of a constant payload stored out of line in a weight section (see mdna_ir_weights.h).
+ * 'offset' is in bytes from the start of the section, 'count' in values.
+ */
+struct WeightRef {
+  int64_t offset{-1};
+  int64_t count{0};
+  NOP_STRUCTURE(WeightRef, offset, count);
+
+  bool IsExternal() const { return offset >= 0; }
+};
+
 struct FloatVecConstant {
   // attributes
   std::vector<float> values;
@@ -186,6 +288,12 @@ struct Conv2d {
   }
 };
 
+/**
+ * @brief Transposed 2D convolution. 'weight' is laid out OIHW exactly like the one of Conv2d: O are the output
+ * channels and I the input channels of one group, which is what GetInputChannels() returns. Input pixel (iy, ix)
+ * of channel i contributes weight[o][i][ky][kx] to output pixel (iy * strides.h - padding.top + ky * dilations.h,
+ * ix * strides.w - padding.left + kx * dilations.w) of every channel o of its group.
+ */
 struct TransConv2d {
   Dilations dilations;
   Padding padding;
@@ -278,6 +386,9 @@ struct QuantizedConv2d {
   }
 };
 
+/**
+ * @brief Quantized TransConv2d, with the same OIHW weight layout.
+ */
 struct QuantizedTransConv2d {
   Dilations dilations;
   Padding padding;
@@ -607,6 +718,139 @@ struct Transpose {
   NOP_STRUCTURE(Transpose, input, dims, perm, output);
 };
 
+/**
+ * @brief Activation folded into one of the Fused* operators.
+ */
+enum class FusedActivation { NONE, RELU, CLIP, LEAKY_RELU, SILU, HSWISH, GELU };
+
+/**
+ * @brief Conv2d followed by an optional BiasAdd and an optional ReLU/Clip/HardTanh, which are all expressed
+ * as a clamp to [min_value, max_value].
+ */
+struct FusedConv2d {
+  Dilations dilations;
+  Padding padding;
+  Strides strides;
+
+  int groups;
+  int output_channels;
+
+  bool has_bias;
+  FusedActivation activation;
+  float min_value;
+  float max_value;
+
+  // inputs
+  Tensor input;
+  Tensor weight;
+  Tensor bias;
+
+  // outputs
+  Tensor output;
+
+  NOP_STRUCTURE(FusedConv2d, dilations, padding, strides, groups, output_channels,
+                has_bias, activation, min_value, max_value, input, weight, bias, output);
+};
+
+/**
+ * @brief QuantizedConv2d followed by a Requantize and an optional LeakyReLU/SiLU/HSwish. When there is no
+ * activation, output_scale/output_zero_point are the ones of the Requantize.
+ */
+struct FusedQuantizedConv2d {
+  Dilations dilations;
+  Padding padding;
+  Strides strides;
+
+  int groups;
+  int output_channels;
+
+  FusedActivation activation;
+  double negative_slope;
+
+  // inputs
+  Tensor input;
+  Tensor weight;
+
+  Tensor input_scale;
+  Tensor input_zero_point;
+  Tensor weight_scale;
+  Tensor weight_zero_point;
+
+  Tensor requant_input_scale;
+  Tensor requant_input_zero_point;
+  Tensor requant_output_scale;
+  Tensor requant_output_zero_point;
+
+  // Only valid for FusedActivation::SILU
+  Tensor sigmoid_scale;
+  Tensor sigmoid_zero_point;
+
+  Tensor output_scale;
+  Tensor output_zero_point;
+
+  // outputs
+  Tensor output;
+
+  NOP_STRUCTURE(FusedQuantizedConv2d, dilations, padding, strides, groups, output_channels,
+                activation, negative_slope, input, weight, input_scale, input_zero_point,
+                weight_scale, weight_zero_point, requant_input_scale, requant_input_zero_point,
+                requant_output_scale, requant_output_zero_point, sigmoid_scale, sigmoid_zero_point,
+                output_scale, output_zero_point, output);
+};
+
+/**
+ * @brief MatMul followed by an optional BiasAdd and an optional GELU.
+ */
+struct FusedMatMul {
+  bool has_bias;
+  FusedActivation activation;
+
+  // inputs
+  Tensor input;
+  Tensor data;
+  Tensor bias;
+
+  // outputs
+  Tensor output;
+
+  NOP_STRUCTURE(FusedMatMul, has_bias, activation, input, data, bias, output);
+};
+
+/**
+ * @brief Constants whose payload was moved out of line into a weight section, see mdna_ir_weights.h. They are
+ * operators of their own rather than a field of FloatVecConstant and friends, so that graphs serialized before
+ * weight sections existed still decode.
+ */
+struct ExternalFloatVecConstant {
+  // attributes
+  WeightRef payload;
+
+  // outputs
+  Tensor output;
+
+  NOP_STRUCTURE(ExternalFloatVecConstant, payload, output);
+};
+
+struct ExternalInt32VecConstant {
+  // attributes
+  WeightRef payload;
+
+  // outputs
+  Tensor output;
+
+  NOP_STRUCTURE(ExternalInt32VecConstant, payload, output);
+};
+
+struct ExternalInt8VecConstant {
+  // attributes
+  WeightRef payload;
+
+  // outputs
+  Tensor output;
+
+  NOP_STRUCTURE(ExternalInt8VecConstant, payload, output);
+};
+
 struct OutputNode {
   std::vector<Tensor> outputs;
   NOP_STRUCTURE(OutputNode, outputs);
@@ -619,41 +863,103 @@ struct Graph {
                        Pad, Int8VecConstant, Upsampling, OutputNode, MaxPool2d,
                        LeakyReLU, SiLU, HSwish, Fc, AvgPooling2d, Mean, Concatenate,
                        UpsamplingFp, LeakyReLUFp, SiLUFp, HSwishFp, HardTanh, Sigmoid,
-                       TransConv2d, QuantizedTransConv2d, GELU, LayerNorm, MatMul, Attention, ConvertType, Transpose>
+                       TransConv2d, QuantizedTransConv2d, GELU, LayerNorm, MatMul, Attention, ConvertType, Transpose,
+                       FusedConv2d, FusedQuantizedConv2d, FusedMatMul, ExternalFloatVecConstant,
+                       ExternalInt32VecConstant, ExternalInt8VecConstant>
       Operator;
 
   std::vector<Operator> operators;
   std::map<std::string, std::vector<QuantizationParameter>> qtz_info;
+  SymbolTable symbols;
 
   template <class Op, class... Args>
   Tensor Add(const std::string& name, DataType type, const Shape& shape,
              Args&&... args) {
-    Tensor result{type, shape, name + std::to_string(next_id_++)};
+    Tensor result = NewTensor(name, type, shape);
     operators.emplace_back(Op{std::forward<Args>(args)..., result});
+    ++revision_;
     return result;
   }
 
+  /**
+   * @brief Creates a new Tensor with a unique name without adding any operator. Meant for rewrite passes that
+   * build operators themselves.
+   */
+  Tensor NewTensor(const std::string& name, DataType type, const Shape& shape) {
+    return Tensor{type, shape, symbols.Intern(name + std::to_string(symbols.Size()))};
+  }
+
+  /**
+   * @brief Returns the debug name given to tensor 't' when it was added to this graph.
+   */
+  const std::string& NameOf(const Tensor& t) const { return symbols.NameOf(t.id); }
+
   void AddOutput(const std::vector<ir::Tensor>& output_tensors) {
     operators.emplace_back(OutputNode{output_tensors});
+    ++revision_;
   }
 
+  /**
+   * @brief Marks the graph as modified. Must be called by passes that edit 'operators' directly so that
+   * any GraphIndex built on this graph gets rebuilt.
+   */
+  void Touch() { ++revision_; }
+
+  uint64_t Revision() const { return revision_; }
+
   Tensor AddFloatVec(const std::vector<float>& values, const Layout &layout) {
-    int size = int(values.size());
-    return Add<FloatVecConstant>("FloatVecConstant", DataType::Float32, Shape{{size}, layout}, values);
+    return AddVec<FloatVecConstant>("FloatVecConstant", DataType::Float32, values, layout);
   }
 
   Tensor AddInt32Vec(const std::vector<int32_t>& values, const Layout &layout) {
-    int size = int(values.size());
-    return Add<Int32VecConstant>("Int32VecConstant", DataType::Int32, Shape{{size}, layout}, values);
+    return AddVec<Int32VecConstant>("Int32VecConstant", DataType::Int32, values, layout);
   }
 
   Tensor AddInt8Vec(const std::vector<int8_t>& values, const Layout &layout) {
+    return AddVec<Int8VecConstant>("Int8VecConstant", DataType::Int8, values, layout);
+  }
+
+  /**
+   * @brief When enabled, AddFloatVec/AddInt32Vec/AddInt8Vec return the already existing Tensor of a constant
+   * with the same type, values and layout instead of adding a new operator.
+   */
+  void SetConstantDedup(bool enable) {
+    dedupe_constants_ = enable;
+    if (!enable) {
+      constant_cache_.clear();
+    }
+  }
+
+  bool ConstantDedup() const { return dedupe_constants_; }
+
+  NOP_STRUCTURE(Graph, operators, qtz_info, symbols);
+  uint64_t revision_{0};
+
+ private:
+  template <class Op, class T>
+  Tensor AddVec(const std::string& name, DataType type, const std::vector<T>& values, const Layout &layout) {
     int size = int(values.size());
-    return Add<Int8VecConstant>("Int8VecConstant", DataType::Int8, Shape{{size}, layout}, values);
+    if (!dedupe_constants_) {
+      return Add<Op>(name, type, Shape{{size}, layout}, values);
+    }
+    uint64_t hash = HashBytes(values.data(), values.size() * sizeof(T), uint64_t(type));
+    hash = HashBytes(layout.layout_values.data(), layout.layout_values.size(), hash);
+    auto &bucket = constant_cache_[hash];
+    for (const size_t idx : bucket) {
+      // Entries may be stale if 'operators' was edited directly, so always compare the payload
+      const Op *op = idx < operators.size() ? operators[idx].template get<Op>() : nullptr;
+      if (op != nullptr && op->values == values && op->output.shape.layout == layout) {
+        return op->output;
+      }
+    }
+    Tensor result = Add<Op>(name, type, Shape{{size}, layout}, values);
+    bucket.push_back(operators.size() - 1);
+    return result;
   }
 
-  NOP_STRUCTURE(Graph, operators, qtz_info);
-  int next_id_{0};
+  // Constant deduplication state, not serialized.
+  bool dedupe_constants_{false};
+  std::unordered_map<uint64_t, std::vector<size_t>> constant_cache_;
 };
 
 struct Module {
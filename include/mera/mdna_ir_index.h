@@ -0,0 +1,329 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_IR_INDEX_H
+#define MDNA_IR_INDEX_H
+
+#include <functional>
+#include <optional>
+#include <queue>
+#include <vector>
+
+#include "mdna_ir.h"
+
+/**
+ * @file mdna_ir_index.h
+ * @brief Operand accessors and producer/consumer index over the operators of a Graph.
+ */
+namespace mera {
+namespace ir {
+
+/**
+ * @brief Visitor returning pointers to all the input tensors of an operator, in declaration order.
+ */
+struct InputsVisitor {
+  using Result = std::vector<Tensor*>;
+
+  Result operator()(Var &n) const { return {}; }
+  Result operator()(FloatVecConstant &n) const { return {}; }
+  Result operator()(Int32VecConstant &n) const { return {}; }
+  Result operator()(Int8VecConstant &n) const { return {}; }
+  Result operator()(ExternalFloatVecConstant &n) const { return {}; }
+  Result operator()(ExternalInt32VecConstant &n) const { return {}; }
+  Result operator()(ExternalInt8VecConstant &n) const { return {}; }
+  Result operator()(ReLU &n) const { return {&n.input}; }
+  Result operator()(AddOp &n) const { return {&n.lhs, &n.rhs}; }
+  Result operator()(Quantize &n) const { return {&n.input, &n.output_scale, &n.output_zero_point}; }
+  Result operator()(Dequantize &n) const { return {&n.input, &n.input_scale, &n.input_zero_point}; }
+  Result operator()(Conv2d &n) const { return {&n.input, &n.weight}; }
+  Result operator()(TransConv2d &n) const { return {&n.input, &n.weight}; }
+  Result operator()(Clip &n) const { return {&n.input}; }
+  Result operator()(QuantizedConv2d &n) const {
+    return {&n.input, &n.weight, &n.input_scale, &n.input_zero_point, &n.weight_scale, &n.weight_zero_point};
+  }
+  Result operator()(QuantizedTransConv2d &n) const {
+    return {&n.input, &n.weight, &n.input_scale, &n.input_zero_point, &n.weight_scale, &n.weight_zero_point};
+  }
+  Result operator()(QuantizedAdd &n) const {
+    return {&n.lhs, &n.rhs, &n.lhs_scale, &n.lhs_zero_point, &n.rhs_scale, &n.rhs_zero_point,
+      &n.output_scale, &n.output_zero_point};
+  }
+  Result operator()(QuantizedMul &n) const {
+    return {&n.lhs, &n.rhs, &n.lhs_scale, &n.lhs_zero_point, &n.rhs_scale, &n.rhs_zero_point,
+      &n.output_scale, &n.output_zero_point};
+  }
+  Result operator()(Requantize &n) const {
+    return {&n.input, &n.input_scale, &n.input_zero_point, &n.output_scale, &n.output_zero_point};
+  }
+  Result operator()(BiasAdd &n) const { return {&n.data, &n.bias}; }
+  Result operator()(Cast &n) const { return {&n.input}; }
+  Result operator()(Pad &n) const { return {&n.input}; }
+  Result operator()(Upsampling &n) const { return {&n.input, &n.input_scale, &n.input_zero_point}; }
+  Result operator()(UpsamplingFp &n) const { return {&n.input}; }
+  Result operator()(MaxPool2d &n) const { return {&n.input}; }
+  Result operator()(LeakyReLU &n) const {
+    return {&n.input, &n.input_scale, &n.input_zero_point, &n.output_scale, &n.output_zero_point};
+  }
+  Result operator()(LeakyReLUFp &n) const { return {&n.input}; }
+  Result operator()(SiLU &n) const {
+    return {&n.input, &n.input_scale, &n.input_zero_point, &n.sigmoid_scale, &n.sigmoid_zero_point,
+      &n.output_scale, &n.output_zero_point};
+  }
+  Result operator()(SiLUFp &n) const { return {&n.input}; }
+  Result operator()(HSwish &n) const {
+    return {&n.input, &n.input_scale, &n.input_zero_point, &n.output_scale, &n.output_zero_point};
+  }
+  Result operator()(HSwishFp &n) const { return {&n.input}; }
+  Result operator()(HardTanh &n) const { return {&n.input}; }
+  Result operator()(Concatenate &n) const {
+    Result r;
+    for (auto &t : n.inputs) { r.push_back(&t); }
+    return r;
+  }
+  Result operator()(Fc &n) const {
+    return {&n.input, &n.weights, &n.input_scale, &n.input_zero_point, &n.weight_scale, &n.weight_zero_point,
+      &n.bias, &n.output_scale, &n.output_zero_point};
+  }
+  Result operator()(AvgPooling2d &n) const { return {&n.input}; }
+  Result operator()(Mean &n) const {
+    return {&n.input, &n.input_scale, &n.input_zero_point, &n.output_scale, &n.output_zero_point};
+  }
+  Result operator()(GELU &n) const { return {&n.input}; }
+  Result operator()(Sigmoid &n) const { return {&n.input}; }
+  Result operator()(LayerNorm &n) const {
+    return n.has_bias ? Result{&n.input, &n.weight, &n.bias} : Result{&n.input, &n.weight};
+  }
+  Result operator()(MatMul &n) const { return {&n.input, &n.data}; }
+  Result operator()(Attention &n) const { return {&n.input_value, &n.input_query, &n.input_key}; }
+  Result operator()(ConvertType &n) const { return {&n.input, &n.scale, &n.zero_point}; }
+  Result operator()(Transpose &n) const { return {&n.input}; }
+  Result operator()(FusedConv2d &n) const {
+    return n.has_bias ? Result{&n.input, &n.weight, &n.bias} : Result{&n.input, &n.weight};
+  }
+  Result operator()(FusedQuantizedConv2d &n) const {
+    Result r{&n.input, &n.weight, &n.input_scale, &n.input_zero_point, &n.weight_scale, &n.weight_zero_point,
+      &n.requant_input_scale, &n.requant_input_zero_point, &n.requant_output_scale, &n.requant_output_zero_point};
+    if (n.activation == FusedActivation::SILU) {
+      r.push_back(&n.sigmoid_scale);
+      r.push_back(&n.sigmoid_zero_point);
+    }
+    if (n.activation != FusedActivation::NONE) {
+      r.push_back(&n.output_scale);
+      r.push_back(&n.output_zero_point);
+    }
+    return r;
+  }
+  Result operator()(FusedMatMul &n) const {
+    return n.has_bias ? Result{&n.input, &n.data, &n.bias} : Result{&n.input, &n.data};
+  }
+  Result operator()(OutputNode &n) const {
+    Result r;
+    for (auto &t : n.outputs) { r.push_back(&t); }
+    return r;
+  }
+
+  Result operator()(nop::EmptyVariant &n) const {
+    throw std::logic_error("Found an empty variant");
+  }
+};
+
+/**
+ * @brief Visitor returning pointers to the output tensors of an operator.
+ */
+struct OutputsVisitor {
+  using Result = std::vector<Tensor*>;
+
+  template <class T>
+  Result operator()(T &n) const { return {&n.output}; }
+
+  Result operator()(OutputNode &n) const { return {}; }
+
+  Result operator()(nop::EmptyVariant &n) const {
+    throw std::logic_error("Found an empty variant");
+  }
+};
+
+/**
+ * @brief Returns the input tensors of 'op'. Can be used to rewire an operator in place.
+ */
+inline std::vector<Tensor*> InputsOf(Graph::Operator &op) { return op.Visit(InputsVisitor{}); }
+
+inline std::vector<const Tensor*> InputsOf(const Graph::Operator &op) {
+  auto r = const_cast<Graph::Operator&>(op).Visit(InputsVisitor{});
+  return std::vector<const Tensor*>(r.begin(), r.end());
+}
+
+/**
+ * @brief Returns the output tensors of 'op'. Every operator but OutputNode has exactly one.
+ */
+inline std::vector<Tensor*> OutputsOf(Graph::Operator &op) { return op.Visit(OutputsVisitor{}); }
+
+inline std::vector<const Tensor*> OutputsOf(const Graph::Operator &op) {
+  auto r = const_cast<Graph::Operator&>(op).Visit(OutputsVisitor{});
+  return std::vector<const Tensor*>(r.begin(), r.end());
+}
+
+/**
+ * @brief Lazily built index of producer/consumer relations of a Graph. Operators are referred to by
+ * their position in Graph::operators and tensors by their TensorId, so that all queries are O(1).
+ *
+ * The index is (re)built on the first query after the graph changed revision (see Graph::Touch()).
+ * The Graph must outlive the index.
+ */
+class GraphIndex {
+ public:
+  using OpIndex = size_t;
+
+  explicit GraphIndex(const Graph &graph): graph_(graph) {}
+
+  /**
+   * @brief Returns the operator producing tensor 'id', if any.
+   */
+  std::optional<OpIndex> Producer(TensorId id) const {
+    Build();
+    if (id < 0 || size_t(id) >= producer_.size() || producer_[id] == kNoOp) {
+      return std::nullopt;
+    }
+    return producer_[id];
+  }
+
+  /**
+   * @brief Returns the operators reading tensor 'id', in graph order.
+   */
+  const std::vector<OpIndex> &Consumers(TensorId id) const {
+    Build();
+    return (id < 0 || size_t(id) >= consumers_.size()) ? empty_ : consumers_[id];
+  }
+
+  /**
+   * @brief Returns the distinct operators producing the inputs of operator 'op'.
+   */
+  const std::vector<OpIndex> &Predecessors(OpIndex op) const { Build(); return preds_.at(op); }
+
+  /**
+   * @brief Returns the distinct operators consuming the outputs of operator 'op'.
+   */
+  const std::vector<OpIndex> &Successors(OpIndex op) const { Build(); return succs_.at(op); }
+
+  size_t FanIn(OpIndex op) const { return Predecessors(op).size(); }
+
+  size_t FanOut(OpIndex op) const { return Successors(op).size(); }
+
+  /**
+   * @brief Returns all operators in a topological order. Ties keep the original graph order, so an already
+   * sorted graph yields the identity. Error if the graph has a cycle.
+   */
+  const std::vector<OpIndex> &TopologicalOrder() const {
+    Build();
+    if (topo_.empty() && !graph_.operators.empty()) {
+      std::vector<size_t> pending(preds_.size());
+      std::priority_queue<OpIndex, std::vector<OpIndex>, std::greater<OpIndex>> ready;
+      for (OpIndex i = 0; i < preds_.size(); ++i) {
+        pending[i] = preds_[i].size();
+        if (pending[i] == 0) {
+          ready.push(i);
+        }
+      }
+      while (!ready.empty()) {
+        const OpIndex op = ready.top();
+        ready.pop();
+        topo_.push_back(op);
+        for (const OpIndex s : succs_[op]) {
+          if (--pending[s] == 0) {
+            ready.push(s);
+          }
+        }
+      }
+      if (topo_.size() != graph_.operators.size()) {
+        topo_.clear();
+        throw std::logic_error("Graph contains a cycle, cannot compute topological order");
+      }
+    }
+    return topo_;
+  }
+
+  /**
+   * @brief Returns whether the next query will rebuild the index.
+   */
+  bool IsStale() const {
+    return !built_ || revision_ != graph_.Revision() || num_ops_ != graph_.operators.size();
+  }
+
+  /**
+   * @brief Drops the cached index, forcing a rebuild on the next query.
+   */
+  void Invalidate() { built_ = false; }
+
+ private:
+  static constexpr OpIndex kNoOp = static_cast<OpIndex>(-1);
+
+  void Build() const {
+    if (!IsStale()) {
+      return;
+    }
+    const auto &ops = graph_.operators;
+    const size_t num_tensors = graph_.symbols.Size();
+    producer_.assign(num_tensors, kNoOp);
+    consumers_.assign(num_tensors, {});
+    preds_.assign(ops.size(), {});
+    succs_.assign(ops.size(), {});
+    topo_.clear();
+
+    auto valid = [&](TensorId id) { return id >= 0 && size_t(id) < num_tensors; };
+    for (OpIndex i = 0; i < ops.size(); ++i) {
+      for (const Tensor *t : OutputsOf(ops[i])) {
+        if (valid(t->id)) {
+          producer_[t->id] = i;
+        }
+      }
+    }
+    for (OpIndex i = 0; i < ops.size(); ++i) {
+      for (const Tensor *t : InputsOf(ops[i])) {
+        if (!valid(t->id)) {
+          continue;
+        }
+        auto &cons = consumers_[t->id];
+        if (cons.empty() || cons.back() != i) {
+          cons.push_back(i);
+        }
+        const OpIndex p = producer_[t->id];
+        if (p != kNoOp && std::find(preds_[i].begin(), preds_[i].end(), p) == preds_[i].end()) {
+          preds_[i].push_back(p);
+          succs_[p].push_back(i);
+        }
+      }
+    }
+    revision_ = graph_.Revision();
+    num_ops_ = ops.size();
+    built_ = true;
+  }
+
+  const Graph &graph_;
+  const std::vector<OpIndex> empty_;
+
+  mutable bool built_{false};
+  mutable uint64_t revision_{0};
+  mutable size_t num_ops_{0};
+  mutable std::vector<OpIndex> producer_;
+  mutable std::vector<std::vector<OpIndex>> consumers_;
+  mutable std::vector<std::vector<OpIndex>> preds_;
+  mutable std::vector<std::vector<OpIndex>> succs_;
+  mutable std::vector<OpIndex> topo_;
+};
+
+}  // namespace ir
+}  // namespace mera
+
+#endif  // MDNA_IR_INDEX_H
@@ -0,0 +1,503 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_IR_INFER_H
+#define MDNA_IR_INFER_H
+
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "mdna_ir.h"
+#include "mdna_ir_index.h"
+
+/**
+ * @file mdna_ir_infer.h
+ * @brief Output type and shape inference for all Graph operators, and whole graph validation.
+ */
+namespace mera {
+namespace ir {
+
+/**
+ * @brief Output type and shape of an operator.
+ */
+struct InferredType {
+  DataType type;
+  Shape shape;
+};
+
+/**
+ * @brief Operators whose output cannot be fully derived from their inputs and attributes, e.g. the shape of a
+ * constant, the target type of a Cast or the scale of an Upsampling. Their declared output is validated against the inputs and kept.
+ */
+template <class Op>
+struct HasDeclaredOutput : std::integral_constant<bool,
+  std::is_same<Op, Var>::value || std::is_same<Op, FloatVecConstant>::value
+  || std::is_same<Op, Int32VecConstant>::value || std::is_same<Op, Int8VecConstant>::value
+  || std::is_same<Op, ExternalFloatVecConstant>::value || std::is_same<Op, ExternalInt32VecConstant>::value
+  || std::is_same<Op, ExternalInt8VecConstant>::value || std::is_same<Op, Cast>::value
+  || std::is_same<Op, Quantize>::value || std::is_same<Op, Requantize>::value || std::is_same<Op, ConvertType>::value
+  || std::is_same<Op, Upsampling>::value || std::is_same<Op, UpsamplingFp>::value
+  || std::is_same<Op, AvgPooling2d>::value || std::is_same<Op, Mean>::value> {};
+
+namespace detail {
+
+inline void Expect(bool cond, const std::string &op, const std::string &msg) {
+  if (!cond) {
+    throw std::runtime_error(op + ": " + msg);
+  }
+}
+
+inline std::string DimsStr(const Shape &s) {
+  std::string r = "[";
+  for (size_t i = 0; i < s.shape.size(); ++i) {
+    r += (i ? "x" : "") + std::to_string(s.shape[i]);
+  }
+  return r + "]";
+}
+
+/**
+ * @brief Returns a copy of 's' with the dimensions of the given layout axes replaced.
+ */
+inline Shape WithDims(const Shape &s, std::initializer_list<std::pair<char, int>> dims) {
+  std::vector<int> d(s.shape.begin(), s.shape.end());
+  for (const auto &[axis, value] : dims) {
+    d.at(s.AxisOf(axis)) = value;
+  }
+  return Shape(d, s.layout);
+}
+
+inline int ConvOutSize(const std::string &name, int in, int pad, int kernel, int stride, int dilation) {
+  const int span = in + pad - dilation * (kernel - 1) - 1;
+  // Division truncates toward zero, so a window larger than the padded input would otherwise give size 1
+  Expect(span >= 0, name, "window of " + std::to_string(dilation * (kernel - 1) + 1)
+    + " does not fit in padded input of " + std::to_string(in + pad));
+  return span / stride + 1;
+}
+
+inline int TransConvOutSize(int in, int pad, int kernel, int stride, int dilation) {
+  return (in - 1) * stride - pad + dilation * (kernel - 1) + 1;
+}
+
+template <class Conv>
+inline Shape Conv2dShape(const std::string &name, const Conv &n, bool transposed) {
+  const Shape &in = n.input.shape;
+  const Shape &w = n.weight.shape;
+  Expect(in.HasDim('H') && in.HasDim('W') && in.HasDim('C'), name, "input layout " + in.layout.AsStr()
+    + " needs H, W and C axes");
+  Expect(w.rank == 4, name, "weight must have rank 4, got " + DimsStr(w));
+  Expect(n.groups > 0 && n.strides.h > 0 && n.strides.w > 0 && n.dilations.h > 0 && n.dilations.w > 0,
+    name, "groups, strides and dilations must be positive");
+  const int kh = w.DimOf('H', w.shape[2]);
+  const int kw = w.DimOf('W', w.shape[3]);
+  // Transposed convolutions use the same OIHW weights, see TransConv2d
+  Expect(in.DimOf('C') == n.GetInputChannels() * n.groups, name, "input has "
+    + std::to_string(in.DimOf('C')) + " channels, weight expects " + std::to_string(n.GetInputChannels()) + " x "
+    + std::to_string(n.groups) + " groups");
+  Expect(n.output_channels % n.groups == 0, name, "output channels not divisible by groups");
+  int oh, ow;
+  if (transposed) {
+    oh = TransConvOutSize(in.DimOf('H'), n.padding.top + n.padding.bottom, kh, n.strides.h, n.dilations.h);
+    ow = TransConvOutSize(in.DimOf('W'), n.padding.left + n.padding.right, kw, n.strides.w, n.dilations.w);
+  } else {
+    oh = ConvOutSize(name, in.DimOf('H'), n.padding.top + n.padding.bottom, kh, n.strides.h, n.dilations.h);
+    ow = ConvOutSize(name, in.DimOf('W'), n.padding.left + n.padding.right, kw, n.strides.w, n.dilations.w);
+  }
+  Expect(oh > 0 && ow > 0, name, "kernel does not fit in padded input " + DimsStr(in));
+  return WithDims(in, {{'H', oh}, {'W', ow}, {'C', n.output_channels}});
+}
+
+/**
+ * @brief Numpy style broadcast of two shapes. The layout of the operand with the highest rank is kept.
+ */
+inline Shape BroadcastShape(const std::string &name, const Shape &lhs, const Shape &rhs) {
+  const Shape &big = lhs.rank >= rhs.rank ? lhs : rhs;
+  const Shape &small = lhs.rank >= rhs.rank ? rhs : lhs;
+  std::vector<int> d(big.shape.begin(), big.shape.end());
+  const int off = big.rank - small.rank;
+  for (int i = 0; i < small.rank; ++i) {
+    const int a = d[off + i];
+    const int b = small.shape[i];
+    Expect(a == b || a == 1 || b == 1, name, "cannot broadcast " + DimsStr(lhs) + " with " + DimsStr(rhs));
+    d[off + i] = std::max(a, b);
+  }
+  return Shape(d, big.layout);
+}
+
+/**
+ * @brief Batched matrix product shape: [..., M, K] x [..., K, N] -> [..., M, N].
+ */
+inline Shape MatMulShape(const std::string &name, const Shape &a, const Shape &b) {
+  Expect(a.rank >= 2 && b.rank >= 2, name, "operands need rank >= 2, got " + DimsStr(a) + " and " + DimsStr(b));
+  Expect(a.shape[a.rank - 1] == b.shape[b.rank - 2], name, "inner dimensions differ: " + DimsStr(a) + " x "
+    + DimsStr(b));
+  std::vector<int> d(a.shape.begin(), a.shape.end());
+  d[a.rank - 1] = b.shape[b.rank - 1];
+  return Shape(d, a.layout);
+}
+
+inline void ExpectSameType(const std::string &name, const Tensor &a, const Tensor &b) {
+  Expect(a.type == b.type, name, "operand types differ: " + ToString(a.type) + " and " + ToString(b.type));
+}
+
+inline void ExpectQuantized(const std::string &name, DataType t) {
+  Expect(t == DataType::Int8 || t == DataType::UInt8, name, "expected a quantized type, got " + ToString(t));
+}
+
+inline void ExpectFloat(const std::string &name, DataType t) {
+  Expect(t == DataType::Float32 || t == DataType::BrainFloat16, name, "expected a float type, got " + ToString(t));
+}
+
+inline int ChannelsOf(const Shape &s) {
+  return s.HasDim('C') ? s.DimOf('C') : s.shape[s.rank - 1];
+}
+
+} // namespace detail
+
+/**
+ * @brief Visitor computing the output type and shape of an operator from its inputs and attributes. Throws
+ * std::runtime_error, prefixed with 'name', describing the first inconsistency found.
+ */
+struct InferVisitor {
+  std::string name;
+
+  InferredType Same(const Tensor &t) const { return {t.type, t.shape}; }
+
+  InferredType operator()(const Var &n) const { return Same(n.output); }
+
+  template <class C>
+  InferredType Constant(const C &n, DataType type) const { return Constant(n.output, int64_t(n.values.size()), type); }
+  template <class C>
+  InferredType External(const C &n, DataType type) const { return Constant(n.output, n.payload.count, type); }
+  InferredType Constant(const Tensor &output, int64_t count, DataType type) const {
+    detail::Expect(output.shape.size == count, name, "constant holds " + std::to_string(count) + " values for shape "
+      + detail::DimsStr(output.shape));
+    return {type, output.shape};
+  }
+  InferredType operator()(const FloatVecConstant &n) const { return Constant(n, DataType::Float32); }
+  InferredType operator()(const Int32VecConstant &n) const { return Constant(n, DataType::Int32); }
+  InferredType operator()(const Int8VecConstant &n) const { return Constant(n, DataType::Int8); }
+  InferredType operator()(const ExternalFloatVecConstant &n) const { return External(n, DataType::Float32); }
+  InferredType operator()(const ExternalInt32VecConstant &n) const { return External(n, DataType::Int32); }
+  InferredType operator()(const ExternalInt8VecConstant &n) const { return External(n, DataType::Int8); }
+
+  InferredType operator()(const ReLU &n) const { return Same(n.input); }
+  InferredType operator()(const Clip &n) const {
+    detail::Expect(n.min_value <= n.max_value, name, "min_value greater than max_value");
+    return Same(n.input);
+  }
+  InferredType operator()(const HardTanh &n) const {
+    detail::Expect(n.min_val <= n.max_val, name, "min_val greater than max_val");
+    return Same(n.input);
+  }
+  InferredType operator()(const LeakyReLUFp &n) const { detail::ExpectFloat(name, n.input.type); return Same(n.input); }
+  InferredType operator()(const SiLUFp &n) const { detail::ExpectFloat(name, n.input.type); return Same(n.input); }
+  InferredType operator()(const HSwishFp &n) const { detail::ExpectFloat(name, n.input.type); return Same(n.input); }
+  InferredType operator()(const GELU &n) const { return Same(n.input); }
+  InferredType operator()(const Sigmoid &n) const { return Same(n.input); }
+  InferredType operator()(const LeakyReLU &n) const { detail::ExpectQuantized(name, n.input.type); return Same(n.input); }
+  InferredType operator()(const SiLU &n) const { detail::ExpectQuantized(name, n.input.type); return Same(n.input); }
+  InferredType operator()(const HSwish &n) const { detail::ExpectQuantized(name, n.input.type); return Same(n.input); }
+
+  InferredType operator()(const AddOp &n) const {
+    detail::ExpectSameType(name, n.lhs, n.rhs);
+    return {n.lhs.type, detail::BroadcastShape(name, n.lhs.shape, n.rhs.shape)};
+  }
+  InferredType operator()(const QuantizedAdd &n) const {
+    detail::ExpectQuantized(name, n.lhs.type);
+    return {n.lhs.type, detail::BroadcastShape(name, n.lhs.shape, n.rhs.shape)};
+  }
+  InferredType operator()(const QuantizedMul &n) const {
+    detail::ExpectQuantized(name, n.lhs.type);
+    return {n.lhs.type, detail::BroadcastShape(name, n.lhs.shape, n.rhs.shape)};
+  }
+
+  InferredType operator()(const Quantize &n) const {
+    detail::ExpectFloat(name, n.input.type);
+    detail::ExpectQuantized(name, n.output.type);
+    detail::Expect(n.axis >= -n.input.shape.rank && n.axis < n.input.shape.rank, name, "axis out of range");
+    return {n.output.type, n.input.shape};
+  }
+  InferredType operator()(const Dequantize &n) const { return {DataType::Float32, n.input.shape}; }
+  InferredType operator()(const Requantize &n) const {
+    detail::ExpectQuantized(name, n.output.type);
+    return {n.output.type, n.input.shape};
+  }
+  InferredType operator()(const Cast &n) const { return {n.output.type, n.input.shape}; }
+  InferredType operator()(const ConvertType &n) const { return {n.output.type, n.input.shape}; }
+
+  InferredType operator()(const Conv2d &n) const { return {n.input.type, detail::Conv2dShape(name, n, false)}; }
+  InferredType operator()(const TransConv2d &n) const { return {n.input.type, detail::Conv2dShape(name, n, true)}; }
+  InferredType operator()(const QuantizedConv2d &n) const {
+    detail::ExpectQuantized(name, n.input.type);
+    return {DataType::Int32, detail::Conv2dShape(name, n, false)};
+  }
+  InferredType operator()(const QuantizedTransConv2d &n) const {
+    detail::ExpectQuantized(name, n.input.type);
+    return {DataType::Int32, detail::Conv2dShape(name, n, true)};
+  }
+  InferredType operator()(const FusedConv2d &n) const {
+    detail::Expect(!n.has_bias || n.bias.shape.size == n.output_channels, name, "bias has "
+      + std::to_string(n.bias.shape.size) + " values for " + std::to_string(n.output_channels) + " output channels");
+    const Conv2d conv{n.dilations, n.padding, n.strides, n.groups, n.output_channels, n.input, n.weight, n.output};
+    return {n.input.type, detail::Conv2dShape(name, conv, false)};
+  }
+  InferredType operator()(const FusedQuantizedConv2d &n) const {
+    detail::ExpectQuantized(name, n.input.type);
+    // The fused Requantize decides the output type, which may differ from the input one (e.g. int8 -> uint8)
+    detail::ExpectQuantized(name, n.output.type);
+    const Conv2d conv{n.dilations, n.padding, n.strides, n.groups, n.output_channels, n.input, n.weight, n.output};
+    return {n.output.type, detail::Conv2dShape(name, conv, false)};
+  }
+
+  InferredType operator()(const BiasAdd &n) const {
+    detail::Expect(n.bias.shape.size == detail::ChannelsOf(n.data.shape), name, "bias has "
+      + std::to_string(n.bias.shape.size) + " values for " + std::to_string(detail::ChannelsOf(n.data.shape))
+      + " channels");
+    return Same(n.data);
+  }
+
+  InferredType operator()(const Pad &n) const {
+    const Shape &in = n.input.shape;
+    detail::Expect(in.HasDim('H') && in.HasDim('W'), name, "input layout " + in.layout.AsStr() + " needs H and W axes");
+    return {n.input.type, detail::WithDims(in, {{'H', in.DimOf('H') + n.pad_width.top + n.pad_width.bottom},
+      {'W', in.DimOf('W') + n.pad_width.left + n.pad_width.right}})};
+  }
+
+  template <class U>
+  InferredType Upsample(const U &n) const {
+    const Shape &in = n.input.shape;
+    const Shape &out = n.output.shape;
+    detail::Expect(in.rank == out.rank && in.layout == out.layout, name, "output layout must match input layout");
+    detail::Expect(in.DimOf('N', 1) == out.DimOf('N', 1) && in.DimOf('C', 1) == out.DimOf('C', 1), name,
+      "batch and channels must be preserved, got " + detail::DimsStr(in) + " -> " + detail::DimsStr(out));
+    return {n.input.type, out};
+  }
+  InferredType operator()(const Upsampling &n) const { return Upsample(n); }
+  InferredType operator()(const UpsamplingFp &n) const { return Upsample(n); }
+
+  InferredType operator()(const MaxPool2d &n) const {
+    const Shape &in = n.input.shape;
+    detail::Expect(in.HasDim('H') && in.HasDim('W'), name, "input layout " + in.layout.AsStr() + " needs H and W axes");
+    detail::Expect(n.strides.h > 0 && n.strides.w > 0, name, "strides must be positive");
+    const int oh = detail::ConvOutSize(name, in.DimOf('H'), n.padding.top + n.padding.bottom, n.pool_height,
+                                       n.strides.h, 1);
+    const int ow = detail::ConvOutSize(name, in.DimOf('W'), n.padding.left + n.padding.right, n.pool_width,
+                                       n.strides.w, 1);
+    detail::Expect(oh > 0 && ow > 0, name, "pool window does not fit in padded input " + detail::DimsStr(in));
+    return {n.input.type, detail::WithDims(in, {{'H', oh}, {'W', ow}})};
+  }
+
+  template <class R>
+  InferredType Reduce(const R &n) const {
+    detail::Expect(n.input.shape.DimOf('N', 1) == n.output.shape.DimOf('N', 1)
+      && n.input.shape.DimOf('C', 1) == n.output.shape.DimOf('C', 1), name, "batch and channels must be preserved");
+    detail::Expect(n.output.shape.size <= n.input.shape.size, name, "reduction cannot grow the tensor");
+    return {n.input.type, n.output.shape};
+  }
+  InferredType operator()(const AvgPooling2d &n) const { return Reduce(n); }
+  InferredType operator()(const Mean &n) const { return Reduce(n); }
+
+  InferredType operator()(const Concatenate &n) const {
+    detail::Expect(!n.inputs.empty(), name, "no inputs");
+    const Tensor &first = n.inputs[0];
+    const int rank = first.shape.rank;
+    const int axis = n.axis < 0 ? n.axis + rank : n.axis;
+    detail::Expect(axis >= 0 && axis < rank, name, "axis " + std::to_string(n.axis) + " out of range");
+    std::vector<int> d(first.shape.shape.begin(), first.shape.shape.end());
+    d[axis] = 0;
+    for (const Tensor &t : n.inputs) {
+      detail::ExpectSameType(name, first, t);
+      detail::Expect(t.shape.rank == rank, name, "inputs have different ranks");
+      for (int i = 0; i < rank; ++i) {
+        detail::Expect(i == axis || t.shape.shape[i] == first.shape.shape[i], name, "input " + detail::DimsStr(t.shape)
+          + " differs from " + detail::DimsStr(first.shape) + " outside the concatenation axis");
+      }
+      d[axis] += t.shape.shape[axis];
+    }
+    return {first.type, Shape(d, first.shape.layout)};
+  }
+
+  InferredType operator()(const Fc &n) const {
+    const Shape &in = n.input.shape;
+    const int k = in.shape[in.rank - 1];
+    detail::Expect(k > 0 && n.weights.shape.size % k == 0, name, "weights " + detail::DimsStr(n.weights.shape)
+      + " do not match input features " + std::to_string(k));
+    const int o = int(n.weights.shape.size / k);
+    detail::Expect(n.bias.shape.size == o || n.bias.shape.size == 1, name, "bias size does not match output features");
+    std::vector<int> d(in.shape.begin(), in.shape.end());
+    d[in.rank - 1] = o;
+    return {n.input.type, Shape(d, in.layout)};
+  }
+
+  InferredType operator()(const LayerNorm &n) const {
+    const int c = n.input.shape.shape[n.input.shape.rank - 1];
+    detail::Expect(n.weight.shape.size == c, name, "weight size does not match normalized dimension");
+    detail::Expect(!n.has_bias || n.bias.shape.size == c, name, "bias size does not match normalized dimension");
+    return Same(n.input);
+  }
+
+  InferredType operator()(const MatMul &n) const {
+    detail::ExpectSameType(name, n.input, n.data);
+    return {n.input.type, detail::MatMulShape(name, n.input.shape, n.data.shape)};
+  }
+  InferredType operator()(const FusedMatMul &n) const {
+    detail::ExpectSameType(name, n.input, n.data);
+    const Shape out = detail::MatMulShape(name, n.input.shape, n.data.shape);
+    detail::Expect(!n.has_bias || n.bias.shape.size == out.shape[out.rank - 1], name, "bias size does not match");
+    return {n.input.type, out};
+  }
+
+  InferredType operator()(const Attention &n) const {
+    detail::Expect(n.num_heads > 0 && n.dim % n.num_heads == 0, name, "dim " + std::to_string(n.dim)
+      + " not divisible by " + std::to_string(n.num_heads) + " heads");
+    detail::Expect(n.seq_length > 0 && n.query_length > 0, name, "sequence lengths must be positive");
+    const Shape &q = n.input_query.shape;
+    std::vector<int> d(q.shape.begin(), q.shape.end());
+    d[q.rank - 1] = n.dim;
+    return {n.input_query.type, Shape(d, q.layout)};
+  }
+
+  InferredType operator()(const Transpose &n) const {
+    const Shape &in = n.input.shape;
+    detail::Expect(int(n.perm.size()) == in.rank && int(n.dims.size()) == in.rank, name,
+      "perm and dims must have the input rank " + std::to_string(in.rank));
+    std::vector<bool> seen(in.rank, false);
+    std::vector<int> d;
+    std::vector<char> l;
+    for (int i = 0; i < in.rank; ++i) {
+      const int p = n.perm[i];
+      detail::Expect(p >= 0 && p < in.rank && !seen[p], name, "perm is not a permutation");
+      seen[p] = true;
+      detail::Expect(n.dims[i].size == in.shape[p], name, "dims[" + std::to_string(i) + "] size "
+        + std::to_string(n.dims[i].size) + " does not match input axis " + std::to_string(p));
+      detail::Expect(n.dims[i].pre_pad >= 0 && n.dims[i].post_pad >= 0, name, "negative padding");
+      d.push_back(n.dims[i].OutputSize());
+      l.push_back(in.layout.layout_values[p]);
+    }
+    return {n.input.type, Shape(d, Layout{{l.begin(), l.end()}})};
+  }
+
+  InferredType operator()(const OutputNode &n) const {
+    throw std::logic_error("OutputNode has no output");
+  }
+
+  InferredType operator()(const nop::EmptyVariant &n) const {
+    throw std::logic_error("Found an empty variant");
+  }
+};
+
+namespace detail {
+
+/**
+ * @brief Name of operator 'i' in error messages: its position and the name of its output, or the numeric id of
+ * the output when it is not part of the symbol table.
+ */
+inline std::string OperatorName(const Graph &g, size_t i, const std::vector<const Tensor*> &outs) {
+  std::string name = "Operator #" + std::to_string(i);
+  if (outs.empty()) {
+    return name + " (OutputNode)";
+  }
+  const TensorId id = outs[0]->id;
+  if (id < 0 || size_t(id) >= g.symbols.Size()) {
+    return name + " (tensor id " + std::to_string(id) + ")";
+  }
+  return name + " (" + g.NameOf(*outs[0]) + ")";
+}
+
+}  // namespace detail
+
+/**
+ * @brief Infers the output of a single operator.
+ */
+inline InferredType InferOutput(const Graph::Operator &op, const std::string &name = "") {
+  return op.Visit(InferVisitor{name});
+}
+
+/**
+ * @brief Checks in a single pass over 'g' that every input refers to an already defined tensor with matching type
+ * and shape, and that every declared output matches its inferred type and dimensions. Throws std::runtime_error
+ * naming the first offending operator.
+ */
+inline void ValidateGraph(const Graph &g) {
+  std::vector<const Tensor*> defined(g.symbols.Size(), nullptr);
+  for (size_t i = 0; i < g.operators.size(); ++i) {
+    const auto &op = g.operators[i];
+    const auto outs = OutputsOf(op);
+    const std::string name = detail::OperatorName(g, i, outs);
+    for (const Tensor *in : InputsOf(op)) {
+      detail::Expect(in->id >= 0 && size_t(in->id) < defined.size() && defined[in->id] != nullptr, name,
+        "input " + std::to_string(in->id) + " used before being defined");
+      const Tensor &def = *defined[in->id];
+      detail::Expect(def.type == in->type && def.shape.shape == in->shape.shape, name, "input "
+        + g.NameOf(*in) + " does not match its definition " + detail::DimsStr(def.shape) + " " + ToString(def.type));
+    }
+    if (outs.empty()) {
+      continue;
+    }
+    const InferredType t = InferOutput(op, name);
+    detail::Expect(t.type == outs[0]->type, name, "declared type " + ToString(outs[0]->type) + ", inferred "
+      + ToString(t.type));
+    detail::Expect(t.shape.shape == outs[0]->shape.shape, name, "declared shape " + detail::DimsStr(outs[0]->shape)
+      + ", inferred " + detail::DimsStr(t.shape));
+    detail::Expect(outs[0]->id >= 0 && size_t(outs[0]->id) < defined.size(), name, "output has unknown tensor id "
+      + std::to_string(outs[0]->id));
+    detail::Expect(defined[outs[0]->id] == nullptr, name, "output defined more than once");
+    defined[outs[0]->id] = outs[0];
+  }
+}
+
+/**
+ * @brief Recomputes, in a single pass, the output type and shape of every operator whose output can be inferred,
+ * and propagates them to all the uses of those tensors.
+ */
+inline void InferShapes(Graph &g) {
+  std::vector<const Tensor*> defined(g.symbols.Size(), nullptr);
+  for (size_t i = 0; i < g.operators.size(); ++i) {
+    auto &op = g.operators[i];
+    for (Tensor *in : InputsOf(op)) {
+      if (in->id >= 0 && size_t(in->id) < defined.size() && defined[in->id] != nullptr) {
+        *in = *defined[in->id];
+      }
+    }
+    auto outs = OutputsOf(op);
+    if (outs.empty()) {
+      continue;
+    }
+    const InferredType t = InferOutput(op, detail::OperatorName(g, i, {outs[0]}));
+    outs[0]->type = t.type;
+    outs[0]->shape = t.shape;
+    if (outs[0]->id >= 0 && size_t(outs[0]->id) < defined.size()) {
+      defined[outs[0]->id] = outs[0];
+    }
+  }
+}
+
+/**
+ * @brief Same as Graph::Add but the output type and shape are inferred. Only available for operators whose
+ * output is fully determined by their inputs and attributes.
+ */
+template <class Op, class... Args>
+inline Tensor AddInferred(Graph &g, const std::string &name, Args&&... args) {
+  static_assert(!HasDeclaredOutput<Op>::value, "Output of this operator cannot be inferred, use Graph::Add");
+  const Graph::Operator probe{Op{args..., Tensor{}}};
+  const InferredType t = InferOutput(probe, name);
+  return g.Add<Op>(name, t.type, t.shape, std::forward<Args>(args)...);
+}
+
+}  // namespace ir
+}  // namespace mera
+
+#endif  // MDNA_IR_INFER_H
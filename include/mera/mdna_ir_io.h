@@ -38,10 +38,19 @@ inline std::ostream& operator<<(std::ostream& os, const Graph::Operator& n) {
   return n.Visit(PrintVisitor{os});
 }
 
+inline std::ostream& operator<<(std::ostream& os, const SymbolTable& n) {
+  os << "SymbolTable(";
+  for (size_t i = 0; i < n.names.size(); ++i) {
+    os << (i ? ", " : "") << i << "=" << n.names[i];
+  }
+  return os << ")";
+}
+
 inline std::ostream& operator<<(std::ostream& os, const Graph& g) {
   for (const auto& node : g.operators) {
     os << node << std::endl;
   }
+  os << g.symbols << std::endl;
   return os;
 }
 
@@ -73,6 +82,11 @@ inline std::ostream& operator<<(std::ostream& os, const QuantizationParameter &n
   return os;
 }
 
+inline std::ostream& operator<<(std::ostream& os, const WeightRef& n) {
+  os << "WeightRef(offset=" << n.offset << ", count=" << n.count << ")";
+  return os;
+}
+
 inline std::ostream& operator<<(std::ostream& os, const Var& n) {
   os << "Var(output=" << n.output << ")";
   return os;
@@ -83,16 +97,31 @@ inline std::ostream& operator<<(std::ostream& os, const FloatVecConstant& n) {
   return os;
 }
 
+inline std::ostream& operator<<(std::ostream& os, const ExternalFloatVecConstant& n) {
+  os << "ExternalFloatConstant(payload=" << n.payload << ", output=" << n.output << ")";
+  return os;
+}
+
 inline std::ostream& operator<<(std::ostream& os, const Int32VecConstant& n) {
   os << "Int32Constant(output=" << n.output << ")";
   return os;
 }
 
+inline std::ostream& operator<<(std::ostream& os, const ExternalInt32VecConstant& n) {
+  os << "ExternalInt32Constant(payload=" << n.payload << ", output=" << n.output << ")";
+  return os;
+}
+
 inline std::ostream& operator<<(std::ostream& os, const Int8VecConstant& n) {
   os << "Int8Constant(output=" << n.output << ")";
   return os;
 }
 
+inline std::ostream& operator<<(std::ostream& os, const ExternalInt8VecConstant& n) {
+  os << "ExternalInt8Constant(payload=" << n.payload << ", output=" << n.output << ")";
+  return os;
+}
+
 inline std::ostream& operator<<(std::ostream& os, const ReLU& n) {
   os << "ReLU(input=" << n.input.id << ", output=" << n.output.id << ")";
   return os;
@@ -377,6 +406,56 @@ inline std::ostream &operator<<(std::ostream& os, const ir::TransposeAxisData& n
   return os << "(" << n.pre_pad << "," << n.size << "," << n.post_pad << ")";
 }
 
+inline std::ostream& operator<<(std::ostream& os, const FusedActivation& n) {
+  static const char *names[] = {"none", "relu", "clip", "leaky_relu", "silu", "hswish", "gelu"};
+  return os << names[int(n)];
+}
+
+inline std::ostream& operator<<(std::ostream& os, const FusedConv2d& n) {
+  os << "FusedConv2d(input=" << n.input.id << ", weights=" << n.weight.id
+     << ", output=" << n.output.id;
+  if (n.has_bias) {
+    os << ", bias=" << n.bias.id;
+  }
+  os << ", dilations=[h=" << n.dilations.h << ",w" << n.dilations.w << "]";
+  os << ", pad=[t=" << n.padding.top << ",b=" << n.padding.bottom
+     << ",l=" << n.padding.left << ",r=" << n.padding.right << "]";
+  os << ", srides=[h=" << n.strides.h << ",w=" << n.strides.w << "]";
+  os << ", groups=" << n.groups;
+  os << ", outputChannels=" << n.output_channels;
+  os << ", activation=" << n.activation << ", min=" << n.min_value << ", max=" << n.max_value;
+  os << ")";
+  return os;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const FusedQuantizedConv2d& n) {
+  os << "FusedQuantizedConv2d(input=" << n.input.id << ", weights=" << n.weight.id
+     << ", output=" << n.output.id;
+  os << ", dilations=[h=" << n.dilations.h << ",w" << n.dilations.w << "]";
+  os << ", pad=[t=" << n.padding.top << ",b=" << n.padding.bottom
+     << ",l=" << n.padding.left << ",r=" << n.padding.right << "]";
+  os << ", srides=[h=" << n.strides.h << ",w=" << n.strides.w << "]";
+  os << ", groups=" << n.groups;
+  os << ", outputChannels=" << n.output_channels;
+  os << ", activation=" << n.activation;
+  if (n.activation == FusedActivation::LEAKY_RELU) {
+    os << ", negative_slope=" << n.negative_slope;
+  }
+  os << ", output_scale=" << n.output_scale.id;
+  os << ", output_zero_point=" << n.output_zero_point.id;
+  os << ")";
+  return os;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const FusedMatMul& n) {
+  os << "FusedMatMul(input=" << n.input.id << ", data=" << n.data.id;
+  if (n.has_bias) {
+    os << ", bias=" << n.bias.id;
+  }
+  os << ", activation=" << n.activation << ", output=" << n.output.id << ")";
+  return os;
+}
+
 inline std::ostream& operator<<(std::ostream& os, const OutputNode& n) {
   os << "OutputNode:output ids=";
   for (auto tensor : n.outputs) {
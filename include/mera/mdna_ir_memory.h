@@ -0,0 +1,190 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_IR_MEMORY_H
+#define MDNA_IR_MEMORY_H
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "nop/serializer.h"
+#include "nop/utility/stream_reader.h"
+#include "nop/utility/stream_writer.h"
+#include "mdna_ir.h"
+#include "mdna_ir_index.h"
+
+/**
+ * @file mdna_ir_memory.h
+ * @brief Static, liveness based placement of the intermediate activations of a Graph into a single arena.
+ */
+namespace mera {
+namespace ir {
+
+/**
+ * @brief Placement of a single intermediate tensor. Lifetimes are expressed as positions in the topological
+ * order of the graph and are inclusive on both ends.
+ */
+struct MemoryAllocation {
+  TensorId id;
+  int64_t offset;
+  int64_t size;
+  int32_t first_use;
+  int32_t last_use;
+  NOP_STRUCTURE(MemoryAllocation, id, offset, size, first_use, last_use);
+};
+
+/**
+ * @brief Arena layout of all intermediate tensors of a Graph. Graph inputs (Var), constants and graph outputs
+ * are owned by the caller and not part of the plan.
+ */
+struct MemoryPlan {
+  int64_t arena_size{0};
+  int64_t alignment{0};
+  std::vector<MemoryAllocation> allocations;
+  NOP_STRUCTURE(MemoryPlan, arena_size, alignment, allocations);
+
+  /**
+   * @brief Sum of the sizes of all planned tensors, i.e. the memory needed without any reuse.
+   */
+  int64_t UnsharedSize() const {
+    int64_t r = 0;
+    for (const auto &a : allocations) { r += a.size; }
+    return r;
+  }
+};
+
+/**
+ * @brief Memory plans of every function of a Module, by function name.
+ */
+using ModuleMemoryPlan = std::map<std::string, MemoryPlan>;
+
+/**
+ * @brief Computes a MemoryPlan for 'g'. Tensors are placed from largest to smallest, each one at the lowest
+ * offset not overlapping any already placed tensor with an intersecting lifetime. Every offset and size is a
+ * multiple of 'alignment'.
+ */
+inline MemoryPlan PlanActivationMemory(const Graph &g, int64_t alignment = 64) {
+  GraphIndex idx(g);
+  const auto &order = idx.TopologicalOrder();
+  std::vector<int32_t> pos(g.operators.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    pos[order[i]] = int32_t(i);
+  }
+
+  MemoryPlan plan;
+  plan.alignment = alignment;
+  for (const size_t op : order) {
+    const auto &n = g.operators[op];
+    if (n.is<Var>() || n.is<FloatVecConstant>() || n.is<Int32VecConstant>() || n.is<Int8VecConstant>()
+        || n.is<ExternalFloatVecConstant>() || n.is<ExternalInt32VecConstant>() || n.is<ExternalInt8VecConstant>()) {
+      continue;
+    }
+    for (const Tensor *t : OutputsOf(n)) {
+      const auto &cons = idx.Consumers(t->id);
+      bool is_output = false;
+      int32_t last = pos[op];
+      for (const size_t c : cons) {
+        is_output |= g.operators[c].is<OutputNode>();
+        last = std::max(last, pos[c]);
+      }
+      if (is_output) {
+        continue;
+      }
+      const int64_t bytes = t->shape.size * int64_t(SizeOf(t->type));
+      const int64_t size = ((bytes + alignment - 1) / alignment) * alignment;
+      plan.allocations.push_back(MemoryAllocation{t->id, 0, size, pos[op], last});
+    }
+  }
+
+  std::vector<size_t> by_size(plan.allocations.size());
+  for (size_t i = 0; i < by_size.size(); ++i) {
+    by_size[i] = i;
+  }
+  std::stable_sort(by_size.begin(), by_size.end(), [&](size_t a, size_t b) {
+    return plan.allocations[a].size > plan.allocations[b].size;
+  });
+
+  std::vector<const MemoryAllocation*> placed;
+  for (const size_t i : by_size) {
+    MemoryAllocation &a = plan.allocations[i];
+    std::vector<const MemoryAllocation*> live;
+    for (const MemoryAllocation *p : placed) {
+      if (p->first_use <= a.last_use && a.first_use <= p->last_use) {
+        live.push_back(p);
+      }
+    }
+    std::sort(live.begin(), live.end(), [](const auto *l, const auto *r) { return l->offset < r->offset; });
+
+    // Best fit: smallest gap between live tensors that can hold 'a', otherwise right after all of them
+    int64_t best = -1;
+    int64_t best_gap = 0;
+    int64_t cursor = 0;
+    for (const MemoryAllocation *p : live) {
+      const int64_t gap = p->offset - cursor;
+      if (gap >= a.size && (best < 0 || gap < best_gap)) {
+        best = cursor;
+        best_gap = gap;
+      }
+      cursor = std::max(cursor, p->offset + p->size);
+    }
+    a.offset = best >= 0 ? best : cursor;
+    plan.arena_size = std::max(plan.arena_size, a.offset + a.size);
+    placed.push_back(&a);
+  }
+  return plan;
+}
+
+/**
+ * @brief Computes the memory plans of all functions of 'mod'.
+ */
+inline ModuleMemoryPlan PlanActivationMemory(const Module &mod, int64_t alignment = 64) {
+  ModuleMemoryPlan plans;
+  for (const auto &[name, graph] : mod.functions) {
+    plans.emplace(name, PlanActivationMemory(graph, alignment));
+  }
+  return plans;
+}
+
+/**
+ * @brief Serializes module memory plans into the format expected by execute::CreateExecutor and
+ * quantizer::CreateQuantizer.
+ */
+inline std::vector<uint8_t> SerializeMemoryPlan(const ModuleMemoryPlan &plans) {
+  nop::Serializer<nop::StreamWriter<std::stringstream>> serializer;
+  auto status = serializer.Write(plans);
+  if (!status) {
+    throw std::runtime_error("Failed to serialize memory plan: " + status.GetErrorMessage());
+  }
+  const std::string bytes = serializer.writer().stream().str();
+  return std::vector<uint8_t>(bytes.begin(), bytes.end());
+}
+
+inline ModuleMemoryPlan DeserializeMemoryPlan(const std::vector<uint8_t> &bytes) {
+  nop::Deserializer<nop::StreamReader<std::stringstream>> deserializer{std::string(bytes.begin(), bytes.end())};
+  ModuleMemoryPlan plans;
+  auto status = deserializer.Read(&plans);
+  if (!status) {
+    throw std::runtime_error("Failed to deserialize memory plan: " + status.GetErrorMessage());
+  }
+  return plans;
+}
+
+}  // namespace ir
+}  // namespace mera
+
+#endif  // MDNA_IR_MEMORY_H
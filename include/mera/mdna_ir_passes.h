@@ -0,0 +1,607 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_IR_PASSES_H
+#define MDNA_IR_PASSES_H
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mdna_ir.h"
+#include "mdna_ir_index.h"
+#include "mdna_pass_profile.h"
+
+/**
+ * @file mdna_ir_passes.h
+ * @brief Graph rewrite passes meant to be run on a Module before handing it to compile::Compile.
+ */
+namespace mera {
+namespace ir {
+
+/**
+ * @brief A rewrite pass on a single Graph. Returns the number of rewrites it applied.
+ */
+struct GraphPass {
+  std::string name;
+  std::function<size_t(Graph&)> run;
+};
+
+/**
+ * @brief Runs 'passes' in order on every function of 'mod'. Returns the total number of rewrites. When
+ * 'profiler' is set every pass run is reported to it, in the same form as the passes of compile::Compile.
+ */
+inline size_t RunPasses(Module &mod, const std::vector<GraphPass> &passes,
+                        CompileProfiler *profiler = nullptr) {
+  size_t count = 0;
+  for (auto &[name, graph] : mod.functions) {
+    for (const auto &pass : passes) {
+      ScopedPassTimer timer(profiler, pass.name, name, graph.operators.size());
+      count += pass.run(graph);
+      timer.Finish(graph.operators.size());
+    }
+  }
+  return count;
+}
+
+namespace detail {
+
+/**
+ * @brief Returns the only consumer of the output of operator 'op' if there is exactly one.
+ */
+inline std::optional<GraphIndex::OpIndex> SoleConsumer(const Graph &g, const GraphIndex &idx, GraphIndex::OpIndex op) {
+  const auto outs = OutputsOf(g.operators[op]);
+  if (outs.size() != 1) {
+    return std::nullopt;
+  }
+  const auto &cons = idx.Consumers(outs[0]->id);
+  return cons.size() == 1 ? std::optional<GraphIndex::OpIndex>(cons[0]) : std::nullopt;
+}
+
+/**
+ * @brief Returns the only consumer of the output of operator 'op' if there is exactly one, and it is of type T.
+ */
+template <class T>
+inline T *SoleConsumerAs(Graph &g, const GraphIndex &idx, GraphIndex::OpIndex op, GraphIndex::OpIndex *consumer) {
+  const auto c = SoleConsumer(g, idx, op);
+  if (!c) {
+    return nullptr;
+  }
+  *consumer = *c;
+  return g.operators[*c].template get<T>();
+}
+
+/**
+ * @brief Removes the operators flagged in 'dead', keeping the relative order of the rest.
+ */
+inline void EraseOperators(Graph &g, const std::vector<bool> &dead) {
+  std::vector<Graph::Operator> kept;
+  kept.reserve(g.operators.size());
+  for (size_t i = 0; i < g.operators.size(); ++i) {
+    if (!dead[i]) {
+      kept.emplace_back(std::move(g.operators[i]));
+    }
+  }
+  g.operators = std::move(kept);
+  g.Touch();
+}
+
+template <class C>
+inline const C *ProducerAs(const Graph &g, const GraphIndex &idx, const Tensor &t) {
+  const auto p = idx.Producer(t.id);
+  return p ? g.operators[*p].template get<C>() : nullptr;
+}
+
+template <class C>
+inline bool SameConstant(const Graph &g, const GraphIndex &idx, const Tensor &a, const Tensor &b) {
+  const C *ca = ProducerAs<C>(g, idx, a);
+  const C *cb = ProducerAs<C>(g, idx, b);
+  return ca != nullptr && cb != nullptr && ca->values == cb->values;
+}
+
+/**
+ * @brief Externalized constants are only known to be the same when they share their payload.
+ */
+template <class C>
+inline bool SameExternalConstant(const Graph &g, const GraphIndex &idx, const Tensor &a, const Tensor &b) {
+  const C *ca = ProducerAs<C>(g, idx, a);
+  const C *cb = ProducerAs<C>(g, idx, b);
+  return ca != nullptr && cb != nullptr && ca->payload.offset == cb->payload.offset
+    && ca->payload.count == cb->payload.count;
+}
+
+/**
+ * @brief True when quantization parameters 'a' and 'b' are the same tensor or constants with the same values.
+ */
+inline bool SameQuantParam(const Graph &g, const GraphIndex &idx, const Tensor &a, const Tensor &b) {
+  return a.id == b.id || SameConstant<FloatVecConstant>(g, idx, a, b) || SameConstant<Int32VecConstant>(g, idx, a, b)
+    || SameConstant<Int8VecConstant>(g, idx, a, b) || SameExternalConstant<ExternalFloatVecConstant>(g, idx, a, b)
+    || SameExternalConstant<ExternalInt32VecConstant>(g, idx, a, b)
+    || SameExternalConstant<ExternalInt8VecConstant>(g, idx, a, b);
+}
+
+/**
+ * @brief True when activation 'act' consumes 'rq' directly with the quantization 'rq' produces, so folding it
+ * into the fused operator keeps the numerics.
+ */
+template <class Act>
+inline bool ConsumesRequantized(const Graph &g, const GraphIndex &idx, const Act &act, const Requantize &rq) {
+  return act.input.id == rq.output.id && SameQuantParam(g, idx, act.input_scale, rq.output_scale)
+    && SameQuantParam(g, idx, act.input_zero_point, rq.output_zero_point);
+}
+
+} // namespace detail
+
+/**
+ * @brief Fuses Conv2d [+ BiasAdd] [+ ReLU/Clip/HardTanh] chains into FusedConv2d. Intermediate results
+ * consumed by anything else than the next operator of the chain prevent the fusion.
+ */
+inline size_t FuseConv2dBiasActivation(Graph &g) {
+  GraphIndex idx(g);
+  std::vector<bool> dead(g.operators.size(), false);
+  size_t fused = 0;
+  for (size_t i = 0; i < g.operators.size(); ++i) {
+    const Conv2d *conv = g.operators[i].get<Conv2d>();
+    if (conv == nullptr || dead[i]) {
+      continue;
+    }
+    FusedConv2d f{conv->dilations, conv->padding, conv->strides, conv->groups, conv->output_channels,
+      false, FusedActivation::NONE, -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(),
+      conv->input, conv->weight, Tensor{}, conv->output};
+    std::vector<size_t> chain{i};
+
+    size_t next;
+    if (const BiasAdd *bias = detail::SoleConsumerAs<BiasAdd>(g, idx, chain.back(), &next)) {
+      if (bias->data.id == f.output.id) {
+        f.has_bias = true;
+        f.bias = bias->bias;
+        f.output = bias->output;
+        chain.push_back(next);
+      }
+    }
+    if (const ReLU *relu = detail::SoleConsumerAs<ReLU>(g, idx, chain.back(), &next)) {
+      f.activation = FusedActivation::RELU;
+      f.min_value = 0.0f;
+      f.output = relu->output;
+      chain.push_back(next);
+    } else if (const Clip *clip = detail::SoleConsumerAs<Clip>(g, idx, chain.back(), &next)) {
+      f.activation = FusedActivation::CLIP;
+      f.min_value = clip->min_value;
+      f.max_value = clip->max_value;
+      f.output = clip->output;
+      chain.push_back(next);
+    } else if (const HardTanh *ht = detail::SoleConsumerAs<HardTanh>(g, idx, chain.back(), &next)) {
+      f.activation = FusedActivation::CLIP;
+      f.min_value = ht->min_val;
+      f.max_value = ht->max_val;
+      f.output = ht->output;
+      chain.push_back(next);
+    }
+
+    if (chain.size() == 1) {
+      continue;
+    }
+    // The fused operator takes the place of the last one of the chain, where all its inputs are already defined
+    for (size_t k = 0; k + 1 < chain.size(); ++k) {
+      dead[chain[k]] = true;
+    }
+    g.operators[chain.back()] = std::move(f);
+    ++fused;
+  }
+  if (fused > 0) {
+    detail::EraseOperators(g, dead);
+  }
+  return fused;
+}
+
+/**
+ * @brief Fuses QuantizedConv2d + Requantize [+ LeakyReLU/SiLU/HSwish] chains into FusedQuantizedConv2d. The fused
+ * operator has no input quantization for the activation, so one is only folded in when it reads the Requantize
+ * output with the same scale and zero point.
+ */
+inline size_t FuseQuantizedConv2dRequantize(Graph &g) {
+  GraphIndex idx(g);
+  std::vector<bool> dead(g.operators.size(), false);
+  size_t fused = 0;
+  for (size_t i = 0; i < g.operators.size(); ++i) {
+    const QuantizedConv2d *conv = g.operators[i].get<QuantizedConv2d>();
+    if (conv == nullptr || dead[i]) {
+      continue;
+    }
+    size_t rq_idx;
+    const Requantize *rq = detail::SoleConsumerAs<Requantize>(g, idx, i, &rq_idx);
+    if (rq == nullptr || rq->input.id != conv->output.id) {
+      continue;
+    }
+    FusedQuantizedConv2d f{conv->dilations, conv->padding, conv->strides, conv->groups, conv->output_channels,
+      FusedActivation::NONE, 0.0, conv->input, conv->weight, conv->input_scale, conv->input_zero_point,
+      conv->weight_scale, conv->weight_zero_point, rq->input_scale, rq->input_zero_point, rq->output_scale,
+      rq->output_zero_point, Tensor{}, Tensor{}, rq->output_scale, rq->output_zero_point, rq->output};
+    std::vector<size_t> chain{i, rq_idx};
+
+    size_t next;
+    const LeakyReLU *leaky = detail::SoleConsumerAs<LeakyReLU>(g, idx, rq_idx, &next);
+    const SiLU *silu = detail::SoleConsumerAs<SiLU>(g, idx, rq_idx, &next);
+    const HSwish *hswish = detail::SoleConsumerAs<HSwish>(g, idx, rq_idx, &next);
+    if (leaky != nullptr && detail::ConsumesRequantized(g, idx, *leaky, *rq)) {
+      f.activation = FusedActivation::LEAKY_RELU;
+      f.negative_slope = leaky->negative_slope;
+      f.output_scale = leaky->output_scale;
+      f.output_zero_point = leaky->output_zero_point;
+      f.output = leaky->output;
+      chain.push_back(next);
+    } else if (silu != nullptr && detail::ConsumesRequantized(g, idx, *silu, *rq)) {
+      f.activation = FusedActivation::SILU;
+      f.sigmoid_scale = silu->sigmoid_scale;
+      f.sigmoid_zero_point = silu->sigmoid_zero_point;
+      f.output_scale = silu->output_scale;
+      f.output_zero_point = silu->output_zero_point;
+      f.output = silu->output;
+      chain.push_back(next);
+    } else if (hswish != nullptr && detail::ConsumesRequantized(g, idx, *hswish, *rq)) {
+      f.activation = FusedActivation::HSWISH;
+      f.output_scale = hswish->output_scale;
+      f.output_zero_point = hswish->output_zero_point;
+      f.output = hswish->output;
+      chain.push_back(next);
+    }
+
+    for (size_t k = 0; k + 1 < chain.size(); ++k) {
+      dead[chain[k]] = true;
+    }
+    g.operators[chain.back()] = std::move(f);
+    ++fused;
+  }
+  if (fused > 0) {
+    detail::EraseOperators(g, dead);
+  }
+  return fused;
+}
+
+/**
+ * @brief Fuses MatMul [+ BiasAdd] [+ GELU] chains into FusedMatMul.
+ */
+inline size_t FuseMatMulBiasGelu(Graph &g) {
+  GraphIndex idx(g);
+  std::vector<bool> dead(g.operators.size(), false);
+  size_t fused = 0;
+  for (size_t i = 0; i < g.operators.size(); ++i) {
+    const MatMul *mm = g.operators[i].get<MatMul>();
+    if (mm == nullptr || dead[i]) {
+      continue;
+    }
+    FusedMatMul f{false, FusedActivation::NONE, mm->input, mm->data, Tensor{}, mm->output};
+    std::vector<size_t> chain{i};
+
+    size_t next;
+    if (const BiasAdd *bias = detail::SoleConsumerAs<BiasAdd>(g, idx, chain.back(), &next)) {
+      if (bias->data.id == f.output.id) {
+        f.has_bias = true;
+        f.bias = bias->bias;
+        f.output = bias->output;
+        chain.push_back(next);
+      }
+    }
+    if (const GELU *gelu = detail::SoleConsumerAs<GELU>(g, idx, chain.back(), &next)) {
+      f.activation = FusedActivation::GELU;
+      f.output = gelu->output;
+      chain.push_back(next);
+    }
+
+    if (chain.size() == 1) {
+      continue;
+    }
+    for (size_t k = 0; k + 1 < chain.size(); ++k) {
+      dead[chain[k]] = true;
+    }
+    g.operators[chain.back()] = std::move(f);
+    ++fused;
+  }
+  if (fused > 0) {
+    detail::EraseOperators(g, dead);
+  }
+  return fused;
+}
+
+/**
+ * @brief Default fusion pipeline.
+ */
+inline std::vector<GraphPass> FusionPasses() {
+  return {
+    {"FuseConv2dBiasActivation", FuseConv2dBiasActivation},
+    {"FuseQuantizedConv2dRequantize", FuseQuantizedConv2dRequantize},
+    {"FuseMatMulBiasGelu", FuseMatMulBiasGelu},
+  };
+}
+
+namespace detail {
+
+inline bool IsPadFree(const Transpose &t) {
+  return std::all_of(t.dims.begin(), t.dims.end(), [](const auto &d) { return d.pre_pad == 0 && d.post_pad == 0; });
+}
+
+inline bool IsIdentityPerm(const std::vector<int> &perm) {
+  for (size_t i = 0; i < perm.size(); ++i) {
+    if (perm[i] != int(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Returns whether applying 'first' and then 'second' leaves every axis in place.
+ */
+inline bool ArePermsInverse(const std::vector<int> &first, const std::vector<int> &second) {
+  if (first.size() != second.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < second.size(); ++i) {
+    if (second[i] < 0 || size_t(second[i]) >= first.size() || first[second[i]] != int(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Builds a pad free Transpose of 'input' into 'output'.
+ */
+inline Transpose MakeTranspose(const Tensor &input, const std::vector<int> &perm, const Tensor &output) {
+  std::vector<TransposeAxisData> dims;
+  for (const int d : output.shape.shape) {
+    dims.emplace_back(d);
+  }
+  return Transpose{input, dims, perm, output};
+}
+
+/**
+ * @brief Layout agnostic operators with a single data input, whose result does not depend on the axis order.
+ */
+inline bool IsElementwiseUnary(const Graph::Operator &op) {
+  return op.is<ReLU>() || op.is<Clip>() || op.is<HardTanh>() || op.is<Sigmoid>() || op.is<GELU>()
+    || op.is<LeakyReLUFp>() || op.is<SiLUFp>() || op.is<HSwishFp>() || op.is<Cast>();
+}
+
+/**
+ * @brief Returns whether following single consumer chains of elementwise operators from Transpose 'op' leads to a
+ * Transpose undoing it. Sinking is only worth it in that case.
+ */
+inline bool ReachesInverseTranspose(const Graph &g, const GraphIndex &idx, GraphIndex::OpIndex op) {
+  const Transpose &t = *g.operators[op].get<Transpose>();
+  for (auto next = SoleConsumer(g, idx, op); next; next = SoleConsumer(g, idx, *next)) {
+    const Graph::Operator &n = g.operators[*next];
+    if (const Transpose *inv = n.get<Transpose>()) {
+      return IsPadFree(*inv) && ArePermsInverse(t.perm, inv->perm);
+    } else if (!IsElementwiseUnary(n)) {
+      return false;
+    }
+  }
+  return false;
+}
+
+} // namespace detail
+
+/**
+ * @brief Removes pairs of pad free Transpose operators whose permutations cancel each other, rewiring the
+ * consumers of the second one to the input of the first. Transposes left without consumers are removed too.
+ */
+inline size_t CancelInverseTransposes(Graph &g) {
+  size_t total = 0;
+  for (bool changed = true; changed;) {
+    changed = false;
+    GraphIndex idx(g);
+    std::vector<bool> dead(g.operators.size(), false);
+    std::vector<bool> touched(g.operators.size(), false);
+    for (size_t j = 0; j < g.operators.size(); ++j) {
+      const Transpose *t2 = g.operators[j].get<Transpose>();
+      if (t2 == nullptr || touched[j] || !detail::IsPadFree(*t2)) {
+        continue;
+      }
+      const auto p = idx.Producer(t2->input.id);
+      const Transpose *t1 = p ? g.operators[*p].get<Transpose>() : nullptr;
+      if (t1 == nullptr || touched[*p] || !detail::IsPadFree(*t1) || !detail::ArePermsInverse(t1->perm, t2->perm)
+          || t1->input.shape != t2->output.shape || t1->input.type != t2->output.type) {
+        continue;
+      }
+      const auto &cons = idx.Consumers(t2->output.id);
+      if (std::any_of(cons.begin(), cons.end(), [&](size_t c) { return touched[c] || g.operators[c].is<OutputNode>(); })) {
+        continue;
+      }
+      const Tensor source = t1->input;
+      const TensorId replaced = t2->output.id;
+      for (const size_t c : cons) {
+        for (Tensor *in : InputsOf(g.operators[c])) {
+          if (in->id == replaced) {
+            *in = source;
+          }
+        }
+        touched[c] = true;
+      }
+      dead[j] = touched[j] = true;
+      touched[*p] = true;
+      const auto &t1_cons = idx.Consumers(t1->output.id);
+      if (std::all_of(t1_cons.begin(), t1_cons.end(), [&](size_t c) { return dead[c]; })) {
+        dead[*p] = true;
+      }
+      ++total;
+      changed = true;
+    }
+    if (changed) {
+      detail::EraseOperators(g, dead);
+    }
+  }
+  return total;
+}
+
+/**
+ * @brief Moves pad free Transpose operators below the layout agnostic operators consuming them, and merges
+ * Concatenate operators whose inputs are all transposed with the same permutation into a single Transpose
+ * after the Concatenate. This brings inverse transposes next to each other so CancelInverseTransposes can
+ * remove them.
+ */
+inline size_t SinkTransposes(Graph &g) {
+  size_t total = 0;
+  for (bool changed = true; changed;) {
+    changed = false;
+    GraphIndex idx(g);
+    std::vector<bool> dead(g.operators.size(), false);
+    std::vector<bool> touched(g.operators.size(), false);
+    for (size_t j = 0; j < g.operators.size(); ++j) {
+      if (touched[j]) {
+        continue;
+      }
+      if (detail::IsElementwiseUnary(g.operators[j])) {
+        const Tensor in = *InputsOf(g.operators[j])[0];
+        const auto p = idx.Producer(in.id);
+        const Transpose *t = p ? g.operators[*p].get<Transpose>() : nullptr;
+        if (t == nullptr || touched[*p] || !detail::IsPadFree(*t) || idx.Consumers(in.id).size() != 1) {
+          continue;
+        }
+        if (!detail::ReachesInverseTranspose(g, idx, *p)) {
+          continue;
+        }
+        // t: x -> in, op: in -> out  becomes  op: x -> tmp, t: tmp -> out
+        const Tensor out = *OutputsOf(g.operators[j])[0];
+        const Tensor tmp = g.NewTensor("SinkTranspose", out.type, t->input.shape);
+        Graph::Operator moved = g.operators[j];
+        *InputsOf(moved)[0] = t->input;
+        *OutputsOf(moved)[0] = tmp;
+        Transpose sunk = detail::MakeTranspose(tmp, t->perm, out);
+        g.operators[*p] = std::move(moved);
+        g.operators[j] = std::move(sunk);
+        touched[*p] = touched[j] = true;
+        ++total;
+        changed = true;
+      } else if (const Concatenate *cat = g.operators[j].get<Concatenate>()) {
+        std::vector<size_t> producers;
+        const Transpose *first = nullptr;
+        for (const Tensor &in : cat->inputs) {
+          const auto p = idx.Producer(in.id);
+          const Transpose *t = p ? g.operators[*p].get<Transpose>() : nullptr;
+          if (t == nullptr || touched[*p] || dead[*p] || !detail::IsPadFree(*t) || idx.Consumers(in.id).size() != 1
+              || (first != nullptr && (t->perm != first->perm || t->input.shape.layout != first->input.shape.layout))) {
+            producers.clear();
+            break;
+          }
+          first = first ? first : t;
+          producers.push_back(*p);
+        }
+        if (producers.empty() || cat->axis < 0 || size_t(cat->axis) >= first->perm.size()) {
+          continue;
+        }
+        const int axis = first->perm[cat->axis];
+        std::vector<Tensor> inputs;
+        std::vector<int> dims(first->input.shape.shape.begin(), first->input.shape.shape.end());
+        dims[axis] = 0;
+        for (const size_t p : producers) {
+          const Tensor &x = g.operators[p].get<Transpose>()->input;
+          inputs.push_back(x);
+          dims[axis] += x.shape.shape[axis];
+        }
+        const Tensor tmp = g.NewTensor("SinkTranspose", cat->output.type, Shape(dims, first->input.shape.layout));
+        Transpose sunk = detail::MakeTranspose(tmp, first->perm, cat->output);
+        const size_t last = *std::max_element(producers.begin(), producers.end());
+        for (const size_t p : producers) {
+          dead[p] = touched[p] = true;
+        }
+        dead[last] = false;
+        g.operators[last] = Concatenate{inputs, axis, tmp};
+        g.operators[j] = std::move(sunk);
+        touched[j] = true;
+        ++total;
+        changed = true;
+      }
+    }
+    if (changed) {
+      detail::EraseOperators(g, dead);
+    }
+  }
+  return total;
+}
+
+/**
+ * @brief Folds identity Transpose operators that only pad the H and W axes with zeros into the Padding of the
+ * Conv2d/FusedConv2d consuming them.
+ */
+inline size_t FoldTransposePadding(Graph &g) {
+  GraphIndex idx(g);
+  std::vector<bool> dead(g.operators.size(), false);
+  size_t folded = 0;
+  for (size_t i = 0; i < g.operators.size(); ++i) {
+    const Transpose *t = g.operators[i].get<Transpose>();
+    if (t == nullptr || !detail::IsIdentityPerm(t->perm) || t->dims.size() != size_t(t->input.shape.rank)
+        || !t->input.shape.HasDim('H') || !t->input.shape.HasDim('W')) {
+      continue;
+    }
+    const int h = t->input.shape.AxisOf('H');
+    const int w = t->input.shape.AxisOf('W');
+    bool pads_hw_only = true;
+    for (int a = 0; a < int(t->dims.size()); ++a) {
+      if (a != h && a != w && (t->dims[a].pre_pad != 0 || t->dims[a].post_pad != 0)) {
+        pads_hw_only = false;
+      }
+    }
+    size_t c;
+    Graph::Operator *consumer = nullptr;
+    if (pads_hw_only && detail::SoleConsumerAs<Conv2d>(g, idx, i, &c) == nullptr) {
+      pads_hw_only = detail::SoleConsumerAs<FusedConv2d>(g, idx, i, &c) != nullptr;
+    }
+    if (!pads_hw_only) {
+      continue;
+    }
+    consumer = &g.operators[c];
+    auto fold = [&](auto &conv) {
+      if (conv.input.id != t->output.id) {
+        return false;
+      }
+      conv.input = t->input;
+      conv.padding.top += t->dims[h].pre_pad;
+      conv.padding.bottom += t->dims[h].post_pad;
+      conv.padding.left += t->dims[w].pre_pad;
+      conv.padding.right += t->dims[w].post_pad;
+      return true;
+    };
+    const bool done = consumer->is<Conv2d>() ? fold(*consumer->get<Conv2d>()) : fold(*consumer->get<FusedConv2d>());
+    if (done) {
+      dead[i] = true;
+      ++folded;
+    }
+  }
+  if (folded > 0) {
+    detail::EraseOperators(g, dead);
+  }
+  return folded;
+}
+
+/**
+ * @brief Default layout propagation pipeline.
+ */
+inline std::vector<GraphPass> LayoutPasses() {
+  return {
+    {"FoldTransposePadding", FoldTransposePadding},
+    {"SinkTransposes", SinkTransposes},
+    {"CancelInverseTransposes", CancelInverseTransposes},
+  };
+}
+
+}  // namespace ir
+}  // namespace mera
+
+#endif  // MDNA_IR_PASSES_H
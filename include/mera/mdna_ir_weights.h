@@ -0,0 +1,367 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_IR_WEIGHTS_H
+#define MDNA_IR_WEIGHTS_H
+
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "nop/serializer.h"
+#include "nop/utility/stream_reader.h"
+#include "nop/utility/stream_writer.h"
+#include "mdna_ir.h"
+
+/**
+ * @file mdna_ir_weights.h
+ * @brief Out of line storage of constant payloads and the on-disk module format using it.
+ *
+ * File layout: [WeightFileHeader][nop serialized Module][padding][weight section]. The Module is stored with
+ * all its constants externalized, so it stays small, and the weight section starts at a kWeightAlignment
+ * aligned file offset so it can be memory mapped and accessed in place.
+ */
+namespace mera {
+namespace ir {
+
+constexpr size_t kWeightAlignment = 64;
+
+/**
+ * @brief Read only view over a contiguous block of constant payloads. Either owns its bytes or maps them
+ * from a file, in which case pages are only loaded by the OS when first accessed.
+ */
+class WeightSection {
+ public:
+  WeightSection() = default;
+  WeightSection(const WeightSection&) = delete;
+  WeightSection &operator=(const WeightSection&) = delete;
+
+  /**
+   * @brief Creates a section owning a copy of 'bytes'.
+   */
+  static std::shared_ptr<WeightSection> FromBytes(std::vector<uint8_t> bytes) {
+    auto ws = std::shared_ptr<WeightSection>(new WeightSection());
+    ws->owned_ = std::move(bytes);
+    ws->data_ = ws->owned_.data();
+    ws->size_ = ws->owned_.size();
+    return ws;
+  }
+
+  /**
+   * @brief Memory maps 'size' bytes at 'offset' of file 'path'. 'offset' needs to be kWeightAlignment aligned.
+   * Defined by the library, so the platform's mapping API stays out of this header.
+   */
+  static std::shared_ptr<WeightSection> Map(const std::string &path, size_t offset, size_t size);
+
+  const uint8_t *Data() const { return data_; }
+
+  size_t Size() const { return size_; }
+
+  bool IsMapped() const { return mapping_ != nullptr; }
+
+  /**
+   * @brief Returns a pointer to the values referenced by 'ref'. Error if out of bounds.
+   */
+  template <class T>
+  const T *Get(const WeightRef &ref) const {
+    // Checked without computing offset + count * sizeof(T), which a corrupt file could make overflow
+    if (!ref.IsExternal() || ref.count < 0 || uint64_t(ref.offset) > size_ || size_t(ref.offset) % alignof(T) != 0
+        || uint64_t(ref.count) > (size_ - size_t(ref.offset)) / sizeof(T)) {
+      throw std::out_of_range("Invalid weight reference at offset " + std::to_string(ref.offset));
+    }
+    return reinterpret_cast<const T*>(data_ + ref.offset);
+  }
+
+ private:
+  std::vector<uint8_t> owned_;
+  // Keeps the file mapping of Map() alive, its deleter unmaps it
+  std::shared_ptr<const void> mapping_;
+  const uint8_t *data_{nullptr};
+  size_t size_{0};
+};
+
+/**
+ * @brief Module loaded from disk together with the weight section its constants point into.
+ */
+struct LoadedModule {
+  Module module;
+  std::shared_ptr<const WeightSection> weights;
+};
+
+struct WeightFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t alignment;
+  uint64_t module_size;
+  uint64_t weights_offset;
+  uint64_t weights_size;
+};
+
+constexpr char kWeightFileMagic[8] = {'M', 'D', 'N', 'A', 'W', 'G', 'T', '\0'};
+constexpr uint32_t kWeightFileVersion = 1;
+
+namespace detail {
+
+inline size_t AlignUp(size_t v, size_t a) { return ((v + a - 1) / a) * a; }
+
+template <class E, class T>
+Graph::Operator Externalize(const std::vector<T> &values, const Tensor &output, std::vector<uint8_t> &section) {
+  const size_t offset = AlignUp(section.size(), kWeightAlignment);
+  const size_t bytes = values.size() * sizeof(T);
+  section.resize(offset + bytes);
+  if (bytes > 0) {
+    std::memcpy(section.data() + offset, values.data(), bytes);
+  }
+  return E{WeightRef{int64_t(offset), int64_t(values.size())}, output};
+}
+
+template <class C, class T>
+Graph::Operator Internalize(const WeightRef &ref, const Tensor &output, const WeightSection &section) {
+  const T *data = section.Get<T>(ref);
+  return C{std::vector<T>(data, data + ref.count), output};
+}
+
+/**
+ * @brief Returns the external counterpart of an inline constant, nothing for other operators.
+ */
+struct ExternalizeVisitor {
+  std::vector<uint8_t> &section;
+  std::optional<Graph::Operator> operator()(const FloatVecConstant &n) const {
+    return Externalize<ExternalFloatVecConstant>(n.values, n.output, section);
+  }
+  std::optional<Graph::Operator> operator()(const Int32VecConstant &n) const {
+    return Externalize<ExternalInt32VecConstant>(n.values, n.output, section);
+  }
+  std::optional<Graph::Operator> operator()(const Int8VecConstant &n) const {
+    return Externalize<ExternalInt8VecConstant>(n.values, n.output, section);
+  }
+  template <class T>
+  std::optional<Graph::Operator> operator()(const T &n) const { return std::nullopt; }
+};
+
+/**
+ * @brief Returns the inline counterpart of an external constant, nothing for other operators.
+ */
+struct InternalizeVisitor {
+  const WeightSection &section;
+  std::optional<Graph::Operator> operator()(const ExternalFloatVecConstant &n) const {
+    return Internalize<FloatVecConstant, float>(n.payload, n.output, section);
+  }
+  std::optional<Graph::Operator> operator()(const ExternalInt32VecConstant &n) const {
+    return Internalize<Int32VecConstant, int32_t>(n.payload, n.output, section);
+  }
+  std::optional<Graph::Operator> operator()(const ExternalInt8VecConstant &n) const {
+    return Internalize<Int8VecConstant, int8_t>(n.payload, n.output, section);
+  }
+  template <class T>
+  std::optional<Graph::Operator> operator()(const T &n) const { return std::nullopt; }
+};
+
+/**
+ * @brief Bytes of a constant payload, held inline or in a weight section. Empty for other operators.
+ */
+struct Payload {
+  const void *data{nullptr};
+  size_t bytes{0};
+  int64_t count{0};
+  bool constant{false};
+};
+
+struct PayloadVisitor {
+  const WeightSection *section;
+  Payload operator()(const FloatVecConstant &n) const { return Inline(n.values); }
+  Payload operator()(const Int32VecConstant &n) const { return Inline(n.values); }
+  Payload operator()(const Int8VecConstant &n) const { return Inline(n.values); }
+  Payload operator()(const ExternalFloatVecConstant &n) const { return External<float>(n.payload); }
+  Payload operator()(const ExternalInt32VecConstant &n) const { return External<int32_t>(n.payload); }
+  Payload operator()(const ExternalInt8VecConstant &n) const { return External<int8_t>(n.payload); }
+  template <class T>
+  Payload operator()(const T &n) const { return {}; }
+
+  template <class T>
+  Payload Inline(const std::vector<T> &values) const {
+    return {values.data(), values.size() * sizeof(T), int64_t(values.size()), true};
+  }
+
+  template <class T>
+  Payload External(const WeightRef &ref) const {
+    if (section == nullptr) {
+      throw std::invalid_argument("Module has externalized weights, its WeightSection is needed to save it");
+    }
+    return {section->Get<T>(ref), size_t(ref.count) * sizeof(T), ref.count, true};
+  }
+};
+
+/**
+ * @brief Copy of an operator with its constant payload replaced by 'ref'. Other operators are copied as is.
+ */
+struct StripPayloadVisitor {
+  WeightRef ref;
+  Graph::Operator operator()(const FloatVecConstant &n) const { return As<ExternalFloatVecConstant>(n); }
+  Graph::Operator operator()(const Int32VecConstant &n) const { return As<ExternalInt32VecConstant>(n); }
+  Graph::Operator operator()(const Int8VecConstant &n) const { return As<ExternalInt8VecConstant>(n); }
+  Graph::Operator operator()(const ExternalFloatVecConstant &n) const { return As<ExternalFloatVecConstant>(n); }
+  Graph::Operator operator()(const ExternalInt32VecConstant &n) const { return As<ExternalInt32VecConstant>(n); }
+  Graph::Operator operator()(const ExternalInt8VecConstant &n) const { return As<ExternalInt8VecConstant>(n); }
+  template <class T>
+  Graph::Operator operator()(const T &n) const { return n; }
+
+  template <class E, class C>
+  Graph::Operator As(const C &n) const { return E{ref, n.output}; }
+};
+
+} // namespace detail
+
+/**
+ * @brief Moves all inline constant payloads of 'mod' into 'section', each one starting at a kWeightAlignment
+ * aligned offset, and replaces their operators with the External* constant referring to it.
+ */
+inline void ExternalizeWeights(Module &mod, std::vector<uint8_t> &section) {
+  for (auto &[name, graph] : mod.functions) {
+    for (auto &op : graph.operators) {
+      if (auto external = op.Visit(detail::ExternalizeVisitor{section})) {
+        op = std::move(*external);
+      }
+    }
+    graph.Touch();
+  }
+}
+
+/**
+ * @brief Copies back all externalized payloads of 'mod' from 'section', turning their operators back into inline
+ * constants.
+ */
+inline void InternalizeWeights(Module &mod, const WeightSection &section) {
+  for (auto &[name, graph] : mod.functions) {
+    for (auto &op : graph.operators) {
+      if (auto internal = op.Visit(detail::InternalizeVisitor{section})) {
+        op = std::move(*internal);
+      }
+    }
+    graph.Touch();
+  }
+}
+
+/**
+ * @brief Writes 'mod' to 'path' using the out of line weight format. Only the graph is serialized in memory,
+ * with every payload replaced by its offset in the weight section; the payloads themselves are streamed to the
+ * file from where they are, so no copy of the weights is made. Constants already externalized are read from
+ * 'weights', which must then be given.
+ */
+inline void SaveModule(const Module &mod, const std::string &path, const WeightSection *weights = nullptr) {
+  Module skeleton;
+  size_t section_size = 0;
+  for (const auto &[name, graph] : mod.functions) {
+    Graph &g = skeleton.functions[name];
+    g.qtz_info = graph.qtz_info;
+    g.symbols = graph.symbols;
+    g.operators.reserve(graph.operators.size());
+    for (const auto &op : graph.operators) {
+      const detail::Payload payload = op.Visit(detail::PayloadVisitor{weights});
+      WeightRef ref{};
+      if (payload.constant) {
+        ref = WeightRef{int64_t(detail::AlignUp(section_size, kWeightAlignment)), payload.count};
+        section_size = size_t(ref.offset) + payload.bytes;
+      }
+      g.operators.push_back(op.Visit(detail::StripPayloadVisitor{ref}));
+    }
+  }
+
+  nop::Serializer<nop::StreamWriter<std::stringstream>> serializer;
+  auto status = serializer.Write(skeleton);
+  if (!status) {
+    throw std::runtime_error("Failed to serialize module: " + status.GetErrorMessage());
+  }
+  const std::string module_bytes = serializer.writer().stream().str();
+
+  WeightFileHeader header{};
+  std::memcpy(header.magic, kWeightFileMagic, sizeof(header.magic));
+  header.version = kWeightFileVersion;
+  header.alignment = kWeightAlignment;
+  header.module_size = module_bytes.size();
+  header.weights_offset = detail::AlignUp(sizeof(header) + module_bytes.size(), kWeightAlignment);
+  header.weights_size = section_size;
+
+  std::ofstream os(path, std::ios::binary | std::ios::trunc);
+  if (!os) {
+    throw std::runtime_error("Could not open " + path + " for writing");
+  }
+  const char padding[kWeightAlignment] = {};
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  os.write(module_bytes.data(), module_bytes.size());
+  os.write(padding, header.weights_offset - sizeof(header) - module_bytes.size());
+  // Same walk as above, so every payload lands at the offset its WeightRef was given
+  size_t written = 0;
+  for (const auto &[name, graph] : mod.functions) {
+    for (const auto &op : graph.operators) {
+      const detail::Payload payload = op.Visit(detail::PayloadVisitor{weights});
+      if (!payload.constant) {
+        continue;
+      }
+      const size_t offset = detail::AlignUp(written, kWeightAlignment);
+      os.write(padding, offset - written);
+      os.write(static_cast<const char*>(payload.data), payload.bytes);
+      written = offset + payload.bytes;
+    }
+  }
+  if (!os.flush()) {
+    throw std::runtime_error("Failed writing module to " + path);
+  }
+}
+
+/**
+ * @brief Loads a module written by SaveModule(). Only the graph is read eagerly; the weight section is memory
+ * mapped and constants keep referring to it through their WeightRef.
+ */
+inline LoadedModule LoadModule(const std::string &path) {
+  std::ifstream is(path, std::ios::binary);
+  if (!is) {
+    throw std::runtime_error("Could not open " + path);
+  }
+  WeightFileHeader header{};
+  is.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!is || std::memcmp(header.magic, kWeightFileMagic, sizeof(header.magic)) != 0) {
+    throw std::runtime_error(path + " is not a MERA module file");
+  }
+  if (header.version != kWeightFileVersion) {
+    throw std::runtime_error("Unsupported MERA module file version " + std::to_string(header.version));
+  }
+
+  std::string module_bytes(header.module_size, '\0');
+  is.read(&module_bytes[0], module_bytes.size());
+  if (!is) {
+    throw std::runtime_error("Module file " + path + " is truncated");
+  }
+  nop::Deserializer<nop::StreamReader<std::stringstream>> deserializer{std::move(module_bytes)};
+  LoadedModule ret;
+  auto status = deserializer.Read(&ret.module);
+  if (!status) {
+    throw std::runtime_error("Failed to deserialize module: " + status.GetErrorMessage());
+  }
+  for (auto &[name, graph] : ret.module.functions) {
+    graph.symbols.BuildLookup();
+  }
+  ret.weights = WeightSection::Map(path, header.weights_offset, header.weights_size);
+  return ret;
+}
+
+}  // namespace ir
+}  // namespace mera
+
+#endif  // MDNA_IR_WEIGHTS_H
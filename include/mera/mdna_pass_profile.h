@@ -0,0 +1,234 @@
+/*
+ * Copyright 2023 EdgeCortix Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MDNA_PASS_PROFILE_H
+#define MDNA_PASS_PROFILE_H
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+#ifdef MERA_COUNT_PASS_ALLOCATIONS
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#endif
+
+/**
+ * @file mdna_pass_profile.h
+ * @brief Per pass time and memory measurement, shared by the IR passes and the compiler.
+ *
+ * Peak allocations are counted per thread by PassAllocations. The compiler library feeds it from its own
+ * allocator. Defining MERA_COUNT_PASS_ALLOCATIONS in exactly one translation unit of the application before
+ * including this header replaces the global operator new and delete with counting versions, which also covers the
+ * passes of mdna_ir_passes.h.
+ */
+namespace mera {
+
+/**
+ * @brief Measurements of a single pass run.
+ */
+struct CompilePassRecord {
+  std::string name;
+  // Name of the module function the pass ran on
+  std::string function;
+  // Start time in microseconds, relative to the creation of the profiler
+  double start_us{0};
+  double wall_us{0};
+  // CPU time of the thread running the pass. Passes running concurrently on other threads are not included, and
+  // neither is work the pass hands to other threads
+  double cpu_us{0};
+  // Peak of the bytes allocated and not yet freed by the thread running the pass, above the level at its start.
+  // 0 when allocations are not counted, see PassAllocations
+  uint64_t peak_alloc_bytes{0};
+  size_t ops_before{0};
+  size_t ops_after{0};
+};
+
+/**
+ * @brief Sink receiving a record after every pass. Passes may run concurrently (see
+ * compile::CompileOptions::num_threads), so implementations need to be thread safe.
+ */
+class CompileProfiler {
+ public:
+  CompileProfiler(): origin_(std::chrono::steady_clock::now()) {}
+  virtual ~CompileProfiler() {}
+
+  virtual void OnPass(const CompilePassRecord &record) = 0;
+
+  /**
+   * @brief Microseconds elapsed since the creation of this profiler.
+   */
+  double NowUs() const {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin_).count();
+  }
+
+ private:
+  const std::chrono::steady_clock::time_point origin_;
+};
+
+/**
+ * @brief Per thread count of the bytes currently allocated and their peak, fed by Allocated() and Freed().
+ */
+class PassAllocations {
+ public:
+  static void Allocated(size_t bytes) {
+    State &s = Get();
+    s.current += int64_t(bytes);
+    if (s.current > s.peak) {
+      s.peak = s.current;
+    }
+  }
+
+  static void Freed(size_t bytes) { Get().current -= int64_t(bytes); }
+
+  /**
+   * @brief Starts a new peak measurement on this thread, returns the level it is relative to.
+   */
+  static int64_t Reset() {
+    State &s = Get();
+    s.peak = s.current;
+    return s.current;
+  }
+
+  static int64_t Peak() { return Get().peak; }
+
+ private:
+  struct State {
+    int64_t current;
+    int64_t peak;
+  };
+
+  static State &Get() {
+    // Constant initialized, so it is safe to use from operator new
+    static thread_local State state{0, 0};
+    return state;
+  }
+};
+
+namespace detail {
+
+/**
+ * @brief CPU time consumed by the calling thread, in microseconds.
+ */
+inline double ThreadCpuUs() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+    return double(ts.tv_sec) * 1e6 + double(ts.tv_nsec) * 1e-3;
+  }
+#endif
+  // Process CPU time, only accurate while a single pass runs at a time
+  return double(std::clock()) * 1e6 / CLOCKS_PER_SEC;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Measures one pass and reports it to 'profiler' on Finish(), or on destruction if Finish() was not called,
+ * e.g. because the pass threw. In that case 'ops_after' is recorded equal to 'ops_before'. The pass must run on
+ * the thread that created the timer. Does nothing when 'profiler' is null.
+ */
+class ScopedPassTimer {
+ public:
+  ScopedPassTimer(CompileProfiler *profiler, const std::string &name, const std::string &function, size_t ops_before):
+    profiler_(profiler) {
+    if (profiler_ != nullptr) {
+      record_.name = name;
+      record_.function = function;
+      record_.ops_before = ops_before;
+      alloc_start_ = PassAllocations::Reset();
+      record_.start_us = profiler_->NowUs();
+      cpu_start_us_ = detail::ThreadCpuUs();
+    }
+  }
+
+  ScopedPassTimer(const ScopedPassTimer&) = delete;
+  ScopedPassTimer &operator=(const ScopedPassTimer&) = delete;
+
+  ~ScopedPassTimer() {
+    try {
+      Finish(record_.ops_before);
+    } catch (...) {
+      // A failing profiler must not turn into std::terminate while unwinding
+    }
+  }
+
+  /**
+   * @brief Reports the pass. 'peak_alloc_bytes' overrides the count of PassAllocations, for callers measuring
+   * allocations by other means; 0 keeps the counted value.
+   */
+  void Finish(size_t ops_after, uint64_t peak_alloc_bytes = 0) {
+    if (profiler_ == nullptr) {
+      return;
+    }
+    record_.wall_us = profiler_->NowUs() - record_.start_us;
+    record_.cpu_us = detail::ThreadCpuUs() - cpu_start_us_;
+    record_.ops_after = ops_after;
+    record_.peak_alloc_bytes = peak_alloc_bytes != 0 ? peak_alloc_bytes :
+                               uint64_t(PassAllocations::Peak() - alloc_start_);
+    CompileProfiler *profiler = profiler_;
+    profiler_ = nullptr;
+    profiler->OnPass(record_);
+  }
+
+ private:
+  CompileProfiler *profiler_;
+  CompilePassRecord record_;
+  double cpu_start_us_{0};
+  int64_t alloc_start_{0};
+};
+
+}  // namespace mera
+
+#ifdef MERA_COUNT_PASS_ALLOCATIONS
+namespace mera {
+namespace detail {
+
+// Size prefix of every counted block, keeping malloc's alignment for the block itself
+constexpr size_t kAllocPrefix = alignof(std::max_align_t);
+
+inline void *CountedAlloc(size_t bytes) {
+  void *p = std::malloc(bytes + kAllocPrefix);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  *static_cast<size_t*>(p) = bytes;
+  PassAllocations::Allocated(bytes);
+  return static_cast<char*>(p) + kAllocPrefix;
+}
+
+inline void CountedFree(void *p) {
+  if (p == nullptr) {
+    return;
+  }
+  void *base = static_cast<char*>(p) - kAllocPrefix;
+  PassAllocations::Freed(*static_cast<size_t*>(base));
+  std::free(base);
+}
+
+}  // namespace detail
+}  // namespace mera
+
+void *operator new(size_t bytes) { return mera::detail::CountedAlloc(bytes); }
+void *operator new[](size_t bytes) { return mera::detail::CountedAlloc(bytes); }
+void operator delete(void *p) noexcept { mera::detail::CountedFree(p); }
+void operator delete[](void *p) noexcept { mera::detail::CountedFree(p); }
+void operator delete(void *p, size_t) noexcept { mera::detail::CountedFree(p); }
+void operator delete[](void *p, size_t) noexcept { mera::detail::CountedFree(p); }
+#endif  // MERA_COUNT_PASS_ALLOCATIONS
+
+#endif  // MDNA_PASS_PROFILE_H
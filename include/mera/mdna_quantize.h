@@ -19,6 +19,8 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <istream>
+#include <ostream>
 
 #include "mdna_ir.h"
 #include "mdna_interpreter.h"
@@ -50,10 +52,31 @@ struct Quantizer : public interpreter::Interpreter_ {
    * the model into a quantized one. Returns a serialized data representation of it.
    */
   virtual std::vector<uint8_t> QuantizeTransform() = 0;
+
+  /**
+   * @brief Same as QuantizeTransform() but writes the serialized quantized model into 'os'.
+   */
+  virtual void QuantizeTransformTo(std::ostream &os) {
+    const auto data = QuantizeTransform();
+    os.write(reinterpret_cast<const char*>(data.data()), data.size());
+  }
 };
 
 std::unique_ptr<Quantizer> CreateQuantizer(const std::vector<uint8_t> &serialized_module);
 
+/**
+ * @brief Creates a quantizer reading the serialized module incrementally from 'serialized_module'.
+ */
+std::unique_ptr<Quantizer> CreateQuantizer(std::istream &serialized_module);
+
+/**
+ * @brief Creates a quantizer whose interpreter buffers follow the memory plan produced by
+ * ir::SerializeMemoryPlan. Intermediate buffers are reused, so GetInterpreterBuffer() only returns valid
+ * data for graph inputs, constants and outputs.
+ */
+std::unique_ptr<Quantizer> CreateQuantizer(const std::vector<uint8_t> &serialized_module,
+  const std::vector<uint8_t> &serialized_memory_plan);
+
 ir::Module LoadMeraQuantizedModule(const std::vector<uint8_t> &transformed_module, const std::string &func_name); 
 
 } // namespace quantizer